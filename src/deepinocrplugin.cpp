@@ -1,14 +1,26 @@
 #include <deepinocrplugin.h>
 #include <deepinocrplugin_p.h>
 #include <toolkits.h>
+#include <ocrscheduler.h>
+#include <threadbudget.h>
+#include <hardwareinfo.h>
+#include <pluginindex.h>
 
 #include <opencv2/opencv.hpp>
 
 #include <algorithm>
 #include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
 #include <filesystem>
 
 #include <dlfcn.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 namespace DeepinOCRPlugin {
 
@@ -23,6 +35,30 @@ public:
     //重置动态库状态
     void resetDlHandle();
 
+    //插件版本号是否不低于version，用于判断插件是否实现了后续版本新增的接口
+    bool pluginVersionAtLeast(int version) const;
+
+    //校验图像数据格式
+    bool checkPixelType(PixelType type);
+
+    //校验YUV420图像的尺寸和行距，不满足要求的数据交给cv::cvtColor会抛出异常
+    bool checkYuvLayout(int height, int width, size_t step, PixelType type);
+
+    //插件是否可以直接接受该格式的图像数据
+    bool pluginAcceptsPixelType(PixelType type);
+
+    //转换为插件要求的格式后设置图像矩阵
+    bool setConvertedMatrix(int height, int width, unsigned char *data, size_t step, PixelType type);
+
+    //通过逐个获取的接口生成扁平化的识别结果，用于不支持getResultView的插件
+    void flattenResults(ResultBuffer &buffer);
+
+    //flattenResults的结果，供getResultView使用
+    ResultBuffer flatResults;
+
+    //不支持结果快照的插件，由管理器在analyze完成后生成快照，只通过原子操作读写
+    std::shared_ptr<const ResultBuffer> snapshot;
+
     //插件安装位置
     std::string pluginInstallDir;
 
@@ -35,11 +71,14 @@ public:
     //插件接口
     Plugin *pluginImpl;
 
+    //会话的插件接口，不为空时pluginImpl指向它，卸载时只需释放
+    std::shared_ptr<Plugin> sessionPlugin;
+
     //插件卸载接口
     int (*unloadPlugin)(void *);
 
     //插件版本号
-    int pluginVersion;
+    int pluginVersion = 0;
 
     //插件加载标记
     bool pluginIsLoaded = false;
@@ -47,6 +86,20 @@ public:
     //运行标记
     std::atomic_bool isRunning = false;
 
+    //调度优先级，以及是否允许在识别的阶段之间让位给更高优先级的任务
+    AnalyzePriority priority = AnalyzePriority::Interactive;
+    bool preemptible = false;
+
+    //最近一次识别的排队等待时间，单位为毫秒
+    double queueWaitMs = 0;
+
+    //调用方设置的逐行回调，可让位时需要在其基础上包装
+    AnalyzeCallbacks callbacks;
+
+    //排队后执行识别，budgetMs不为0时从start开始计算时间预算，排队时间也计入预算
+    //hasBudget输出插件是否支持时间预算
+    bool analyze(unsigned int budgetMs, std::chrono::steady_clock::time_point start, bool &hasBudget);
+
     //占位
     char r[2];
 };
@@ -67,10 +120,22 @@ bool DeepinOCRDriver_impl::isCompatible(int version)
     return true;
 }
 
+bool DeepinOCRDriver_impl::pluginVersionAtLeast(int version) const
+{
+    return pluginVersion >= version;
+}
+
 void DeepinOCRDriver_impl::resetDlHandle()
 {
     if(pluginIsLoaded) {
-        if(isRunning || unloadPlugin(pluginImpl) == 0) { //正在运行或卸载失败
+        if(isRunning) { //正在运行
+            DEEPIN_LOG("unload plugin failed");
+            return;
+        }
+
+        if(sessionPlugin != nullptr) { //会话只需释放，释放代码位于插件中，需要在dlclose之前完成
+            sessionPlugin.reset();
+        } else if(unloadPlugin(pluginImpl) == 0) { //卸载失败
             DEEPIN_LOG("unload plugin failed");
             return;
         }
@@ -84,6 +149,19 @@ void DeepinOCRDriver_impl::resetDlHandle()
     pluginIsLoaded = false;
 }
 
+void DeepinOCRDriver_impl::flattenResults(ResultBuffer &buffer)
+{
+    buffer.clear();
+
+    auto boxes = pluginImpl->getTextBoxes();
+    for(size_t i = 0; i != boxes.size(); ++i) {
+        for(auto &charBox : pluginImpl->getCharBoxes(i)) {
+            ResultBuffer::appendQuad(buffer.charQuads, charBox);
+        }
+        buffer.appendLine(boxes[i], pluginImpl->getResultFromBox(i));
+    }
+}
+
 DeepinOCRDriver::DeepinOCRDriver()
     : impl(new DeepinOCRDriver_impl)
 {
@@ -97,14 +175,201 @@ DeepinOCRDriver::~DeepinOCRDriver()
 
 std::vector<std::string> DeepinOCRDriver::getPluginNames()
 {
-    return getSubDirNames(impl->pluginInstallDir);
+    return PluginIndex::instance().names(impl->pluginInstallDir);
+}
+
+//推荐插件的进程内缓存，键为硬件、指令集和各插件动态库的状态
+static std::mutex bestPluginsMutex;
+static std::string bestPluginsKey;
+static std::vector<std::string> bestPlugins;
+
+//测速用的合成图像：白底上的若干黑色横条，模拟一页文本
+static cv::Mat calibrationImage()
+{
+    cv::Mat image(720, 960, CV_8UC3, cv::Scalar(255, 255, 255));
+    for(int y = 24; y + 40 < image.rows; y += 48) {
+        image.rowRange(y, y + 20).colRange(60, image.cols - 120).setTo(cv::Scalar(0, 0, 0));
+    }
+    return image;
+}
+
+//测速结果中的特殊值
+static constexpr double CalibrationFailed = -1;   //测速失败
+static constexpr double CalibrationUnusable = -2; //插件不适用于当前环境
+static constexpr double CalibrationOnline = -3;   //只支持网络的在线插件，不测速
+
+//插件支持的硬件中是否只有网络可用
+static bool onlyNetworkUsable(const std::vector<HardwareID> &supported, const std::vector<HardwareID> &hardware)
+{
+    bool usable = false;
+    for(auto id : supported) {
+        if(std::find(hardware.begin(), hardware.end(), id) == hardware.end()) {
+            continue;
+        }
+        if(id != HardwareID::Network) {
+            return false;
+        }
+        usable = true;
+    }
+    return usable;
+}
+
+//测量插件识别一张合成图像的耗时，单位为毫秒，插件不适用于当前环境或测速失败时返回上面的特殊值
+//在线插件不测速，否则查询推荐插件时会把图像发送到远程服务，测得的也只是网络延迟
+static double calibratePlugin(const std::string &pluginName, const std::vector<HardwareID> &hardware, cv::Mat &image)
+{
+    //有清单的插件先按清单中的硬件筛选，不适用的插件和在线插件不需要加载
+    DeepinOCRDriver driver;
+    PluginManifest manifest;
+    if(driver.getPluginManifest(pluginName, manifest) && !manifest.hardware.empty()) {
+        bool listed = std::any_of(manifest.hardware.begin(), manifest.hardware.end(), [&hardware](HardwareID id) {
+            return std::find(hardware.begin(), hardware.end(), id) != hardware.end();
+        });
+        if(!listed) {
+            return CalibrationUnusable;
+        }
+        if(onlyNetworkUsable(manifest.hardware, hardware)) {
+            return CalibrationOnline;
+        }
+    }
+
+    if(!driver.loadPlugin(pluginName)) {
+        return CalibrationUnusable;
+    }
+
+    //插件支持的硬件中至少有一项当前可用，可用的GPU交给插件使用
+    auto supported = driver.getHardwareSupportList();
+    if(onlyNetworkUsable(supported, hardware)) {
+        return CalibrationOnline;
+    }
+
+    bool usable = false;
+    std::vector<std::pair<HardwareID, int>> hardwareUsed;
+    for(auto id : supported) {
+        if(id == HardwareID::Network || std::find(hardware.begin(), hardware.end(), id) == hardware.end()) {
+            continue;
+        }
+        usable = true;
+        if(id >= HardwareID::GPU_Any) {
+            hardwareUsed.emplace_back(id, 0);
+        }
+    }
+    if(!usable) {
+        return CalibrationUnusable;
+    }
+    if(!hardwareUsed.empty()) {
+        driver.setUseHardware(hardwareUsed);
+    }
+
+    //第一次识别包括模型加载，不计入耗时
+    if(!driver.setMatrix(image.rows, image.cols, image.data, image.step, PixelType::Pixel_BGR)) {
+        return CalibrationFailed;
+    }
+    driver.analyze();
+    auto begin = std::chrono::steady_clock::now();
+    driver.analyze();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
 }
 
 std::vector<std::string> DeepinOCRDriver::getBestPluginNames()
 {
-    //TODO：需要deepin-GPUInfo支持
-    DEEPIN_LOG("getBestPluginNames is not support yet");
-    return std::vector<std::string>();
+    auto names = getPluginNames();
+    if(names.empty()) {
+        return std::vector<std::string>();
+    }
+    std::sort(names.begin(), names.end());
+
+    //缓存的键：可用的硬件、CPU指令集，以及每个插件动态库的大小和修改时间
+    auto hardware = detectHardware();
+    std::string key = cpuFeatures() + "|";
+    for(auto id : hardware) {
+        key += std::to_string(static_cast<int>(id)) + ",";
+    }
+    for(auto &name : names) {
+        struct stat info;
+        key += "|" + name;
+        if(stat((impl->pluginInstallDir + name + "/libload.so").c_str(), &info) == 0) {
+            key += ":" + std::to_string(info.st_size) + ":" + std::to_string(info.st_mtim.tv_sec) + "." + std::to_string(info.st_mtim.tv_nsec);
+        }
+    }
+
+    std::lock_guard<std::mutex> locker(bestPluginsMutex);
+    if(bestPluginsKey == key) {
+        return bestPlugins;
+    }
+
+    //磁盘缓存：第一行为键，之后每行一个插件名
+    std::string cacheDir = getUserCacheDir();
+    std::string cachePath = cacheDir.empty() ? "" : cacheDir + "/best-plugins.cache";
+    if(!cachePath.empty()) {
+        std::ifstream fs(cachePath);
+        std::string line;
+        if(std::getline(fs, line) && line == key) {
+            bestPlugins.clear();
+            while(std::getline(fs, line)) {
+                if(!line.empty()) {
+                    bestPlugins.push_back(line);
+                }
+            }
+            bestPluginsKey = key;
+            return bestPlugins;
+        }
+    }
+
+    //逐个测速，本地插件按耗时排列，测速失败的本地插件在其后，在线插件排在最后
+    std::vector<std::pair<std::string, double>> candidates;
+    cv::Mat image = calibrationImage();
+    for(auto &name : names) {
+        double elapsed = calibratePlugin(name, hardware, image);
+        DEEPIN_LOG("plugin %s calibration: %.1f ms", name.c_str(), elapsed);
+        if(elapsed != CalibrationUnusable) {
+            candidates.emplace_back(name, elapsed);
+        }
+    }
+    auto rank = [](double elapsed) {
+        if(elapsed == CalibrationOnline) {
+            return 2;
+        }
+        return elapsed == CalibrationFailed ? 1 : 0;
+    };
+    std::stable_sort(candidates.begin(), candidates.end(), [&rank](const std::pair<std::string, double> &left, const std::pair<std::string, double> &right) {
+        if(rank(left.second) != rank(right.second)) {
+            return rank(left.second) < rank(right.second);
+        }
+        return left.second < right.second;
+    });
+
+    bestPlugins.clear();
+    for(auto &candidate : candidates) {
+        bestPlugins.push_back(candidate.first);
+    }
+    bestPluginsKey = key;
+
+    //先写入临时文件再重命名，避免其他进程读到写了一半的文件
+    if(!cachePath.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(cacheDir, error);
+        std::string tempPath = cachePath + ".tmp" + std::to_string(getpid());
+        std::ofstream fs(tempPath, std::ios::trunc);
+        if(fs.is_open()) {
+            fs << key << "\n";
+            for(auto &name : bestPlugins) {
+                fs << name << "\n";
+            }
+            fs.close();
+            std::filesystem::rename(tempPath, cachePath, error);
+            if(error) {
+                std::filesystem::remove(tempPath, error);
+            }
+        }
+    }
+
+    return bestPlugins;
+}
+
+bool DeepinOCRDriver::getPluginManifest(const std::string &pluginName, PluginManifest &manifest)
+{
+    return PluginIndex::instance().manifest(impl->pluginInstallDir, pluginName, manifest);
 }
 
 bool DeepinOCRDriver::loadDefaultPlugin()
@@ -114,6 +379,7 @@ bool DeepinOCRDriver::loadDefaultPlugin()
 
     //加载默认插件
     impl->unloadPlugin = ::unloadPlugin;
+    impl->pluginVersion = ::pluginVersion();
     impl->pluginImpl = reinterpret_cast<Plugin *>(::loadPlugin());
     if(impl->pluginImpl != nullptr) {
         impl->pluginIsLoaded = true;
@@ -143,6 +409,13 @@ bool DeepinOCRDriver::loadPlugin(const std::string &pluginName)
         return false;
     }
 
+    //有清单的插件先检查版本，明显不兼容时不需要打开动态库
+    PluginManifest manifest;
+    if(getPluginManifest(pluginName, manifest) && manifest.version != 0 && !impl->isCompatible(manifest.version)) {
+        DEEPIN_LOG("plugin %s version check failed", pluginName.c_str());
+        return false;
+    }
+
     //执行加载步骤
 
     //0.重置状态
@@ -199,6 +472,7 @@ bool DeepinOCRDriver::loadPlugin(const std::string &pluginName)
     //插件卸载接口
     impl->unloadPlugin = unloadFunc;
 
+    impl->pluginName = pluginName;
     impl->pluginIsLoaded = true;
 
     DEEPIN_LOG("plugin %s load successed", pluginName.c_str());
@@ -305,52 +579,31 @@ bool DeepinOCRDriver::setImageFile(const std::string &filePath)
     }
 }
 
-bool DeepinOCRDriver::setMatrix(int height, int width, unsigned char *data, size_t step, PixelType type)
+//构建指向外部数据的矩阵头，不拷贝数据
+static cv::Mat wrapMatrix(int height, int width, unsigned char *data, size_t step, PixelType type)
 {
-    if(!pluginIsLoaded()) {
-        DEEPIN_LOG("you need load a plugin first");
-        return false;
-    }
-
-    auto requestPixelType = impl->pluginImpl->getPixelType();
-
-    if(requestPixelType == PixelType::Pixel_Unknown || type == PixelType::Pixel_Unknown) {
-        if(requestPixelType == PixelType::Pixel_Unknown) {
-            DEEPIN_LOG("plugin request pixel type is unknown, try setImageFile");
-        } else {
-            DEEPIN_LOG("your pixel type is unknown");
-        }
-        return false;
-    }
-
-    //一样则直接传输数据
-    if(type == requestPixelType) {
-        return impl->pluginImpl->setMatrix(height, width, data, step);
-    }
-
-    //不一样的时候先执行转换操作，此处使用opencv完成
-
-    //构建
-    cv::Mat mat;
-
     switch(type)
     {
     default:
-        break;
+        return cv::Mat();
     case PixelType::Pixel_GRAY:
-        mat = cv::Mat(height, width, CV_8UC1, data, step);
-        break;
+        return cv::Mat(height, width, CV_8UC1, data, step);
     case PixelType::Pixel_RGB:
     case PixelType::Pixel_BGR:
-        mat = cv::Mat(height, width, CV_8UC3, data, step);
-        break;
+        return cv::Mat(height, width, CV_8UC3, data, step);
     case PixelType::Pixel_RGBA:
     case PixelType::Pixel_BGRA:
-        mat = cv::Mat(height, width, CV_8UC4, data, step);
-        break;
+        return cv::Mat(height, width, CV_8UC4, data, step);
+    case PixelType::Pixel_NV12:
+    case PixelType::Pixel_NV21:
+    case PixelType::Pixel_I420:
+        return cv::Mat(height * 3 / 2, width, CV_8UC1, data, step);
     };
+}
 
-    //获得转换代码
+//获得转换代码，无法转换时返回-1
+static int getCvtCode(PixelType type, PixelType requestPixelType)
+{
     int cvtCode = -1;
     if(type == PixelType::Pixel_GRAY) {//灰度图
         if(requestPixelType == PixelType::Pixel_BGR || requestPixelType == PixelType::Pixel_RGB) {
@@ -392,16 +645,252 @@ bool DeepinOCRDriver::setMatrix(int height, int width, unsigned char *data, size
                   (type == PixelType::Pixel_BGRA && requestPixelType == PixelType::Pixel_BGR)) {
             cvtCode = cv::COLOR_RGBA2RGB;
         }
+    } else if(type == PixelType::Pixel_NV12 || type == PixelType::Pixel_NV21 || type == PixelType::Pixel_I420) { //YUV420图
+        //按NV12、NV21、I420的顺序排列
+        static const int toBGR[] = {cv::COLOR_YUV2BGR_NV12, cv::COLOR_YUV2BGR_NV21, cv::COLOR_YUV2BGR_I420};
+        static const int toRGB[] = {cv::COLOR_YUV2RGB_NV12, cv::COLOR_YUV2RGB_NV21, cv::COLOR_YUV2RGB_I420};
+        static const int toBGRA[] = {cv::COLOR_YUV2BGRA_NV12, cv::COLOR_YUV2BGRA_NV21, cv::COLOR_YUV2BGRA_I420};
+        static const int toRGBA[] = {cv::COLOR_YUV2RGBA_NV12, cv::COLOR_YUV2RGBA_NV21, cv::COLOR_YUV2RGBA_I420};
+        int index = static_cast<int>(type) - static_cast<int>(PixelType::Pixel_NV12);
+        if(requestPixelType == PixelType::Pixel_GRAY) {
+            cvtCode = cv::COLOR_YUV2GRAY_420;
+        } else if(requestPixelType == PixelType::Pixel_BGR) {
+            cvtCode = toBGR[index];
+        } else if(requestPixelType == PixelType::Pixel_RGB) {
+            cvtCode = toRGB[index];
+        } else if(requestPixelType == PixelType::Pixel_BGRA) {
+            cvtCode = toBGRA[index];
+        } else if(requestPixelType == PixelType::Pixel_RGBA) {
+            cvtCode = toRGBA[index];
+        }
+    }
+
+    return cvtCode;
+}
+
+bool DeepinOCRDriver_impl::checkPixelType(PixelType type)
+{
+    auto requestPixelType = pluginImpl->getPixelType();
+
+    if(requestPixelType == PixelType::Pixel_Unknown || type == PixelType::Pixel_Unknown) {
+        if(requestPixelType == PixelType::Pixel_Unknown) {
+            DEEPIN_LOG("plugin request pixel type is unknown, try setImageFile");
+        } else {
+            DEEPIN_LOG("your pixel type is unknown");
+        }
+        return false;
+    }
+
+    return true;
+}
+
+bool DeepinOCRDriver_impl::checkYuvLayout(int height, int width, size_t step, PixelType type)
+{
+    if(type != PixelType::Pixel_NV12 && type != PixelType::Pixel_NV21 && type != PixelType::Pixel_I420) {
+        return true;
+    }
+
+    //色度平面的宽高均为Y平面的一半，奇数尺寸无法对齐
+    if(height <= 0 || width <= 0 || height % 2 != 0 || width % 2 != 0) {
+        DEEPIN_LOG("YUV420 image height and width must be positive even numbers");
+        return false;
+    }
+
+    if(step < static_cast<size_t>(width)) {
+        DEEPIN_LOG("YUV420 image step must not be less than width");
+        return false;
     }
 
-    //执行转换
+    return true;
+}
+
+bool DeepinOCRDriver_impl::pluginAcceptsPixelType(PixelType type)
+{
+    if(!pluginVersionAtLeast(0x100200)) {
+        return type == pluginImpl->getPixelType();
+    }
+
+    auto types = pluginImpl->getPixelTypeSupportList();
+    return std::find(types.begin(), types.end(), type) != types.end();
+}
+
+bool DeepinOCRDriver_impl::setConvertedMatrix(int height, int width, unsigned char *data, size_t step, PixelType type)
+{
+    //不一样的时候先执行转换操作，此处使用opencv完成
+    int cvtCode = getCvtCode(type, pluginImpl->getPixelType());
     if(cvtCode == -1) {
         DEEPIN_LOG("pixel convert failed");
         return false;
+    }
+
+    //转换结果写入新的缓冲区，不能原地转换，否则会改写调用方的数据
+    auto converted = std::make_shared<cv::Mat>();
+    cv::cvtColor(wrapMatrix(height, width, data, step, type), *converted, cvtCode);
+
+    //转换结果已经是独占的数据，直接转交给插件，避免插件内部再拷贝一次
+    if(pluginVersionAtLeast(0x100100)) {
+        return pluginImpl->setMatrixBorrowed(converted->rows, converted->cols, converted->data, converted->step, converted);
     } else {
-        cv::cvtColor(mat, mat, cvtCode);
-        return impl->pluginImpl->setMatrix(mat.rows, mat.cols, mat.data, mat.step);
+        return pluginImpl->setMatrix(converted->rows, converted->cols, converted->data, converted->step);
+    }
+}
+
+bool DeepinOCRDriver::setImageData(const unsigned char *data, size_t size)
+{
+    if(!pluginIsLoaded()) {
+        DEEPIN_LOG("you need load a plugin first");
+        return false;
+    }
+
+    if(data == nullptr || size == 0) {
+        DEEPIN_LOG("image data is empty");
+        return false;
     }
+
+    if(!impl->pluginVersionAtLeast(0x100300)) {
+        DEEPIN_LOG("current plugin do not support setImageData, try setImageFile");
+        return false;
+    }
+
+    return impl->pluginImpl->setImageData(data, size);
+}
+
+bool DeepinOCRDriver::setImageFd(int fd)
+{
+    if(!pluginIsLoaded()) {
+        DEEPIN_LOG("you need load a plugin first");
+        return false;
+    }
+
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0) {
+        DEEPIN_LOG("fd %d is invalid", fd);
+        return false;
+    }
+
+    //普通文件直接映射到内存，避免额外的拷贝
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    if(S_ISREG(fileStat.st_mode) && offset >= 0 && offset < fileStat.st_size) {
+        void *mapped = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapped != MAP_FAILED) {
+            auto result = setImageData(static_cast<const unsigned char *>(mapped) + offset, static_cast<size_t>(fileStat.st_size - offset));
+            munmap(mapped, static_cast<size_t>(fileStat.st_size));
+            return result;
+        }
+    }
+
+    //管道、套接字等无法映射的情况下读取全部内容
+    std::vector<unsigned char> buffer;
+    unsigned char block[65536];
+    while(true) {
+        ssize_t readSize = read(fd, block, sizeof(block));
+        if(readSize > 0) {
+            buffer.insert(buffer.end(), block, block + readSize);
+        } else if(readSize == 0) {
+            break;
+        } else if(errno != EINTR) {
+            DEEPIN_LOG("read fd %d failed", fd);
+            return false;
+        }
+    }
+
+    return setImageData(buffer.data(), buffer.size());
+}
+
+bool DeepinOCRDriver::setMatrix(int height, int width, unsigned char *data, size_t step, PixelType type)
+{
+    if(!pluginIsLoaded()) {
+        DEEPIN_LOG("you need load a plugin first");
+        return false;
+    }
+
+    if(!impl->checkPixelType(type) || !impl->checkYuvLayout(height, width, step, type)) {
+        return false;
+    }
+
+    //一样则直接传输数据
+    if(type == impl->pluginImpl->getPixelType()) {
+        return impl->pluginImpl->setMatrix(height, width, data, step);
+    }
+
+    //插件可以直接处理该格式时，拷贝一份原始数据后以独占数据的方式交给插件，格式转换由插件按需进行
+    if(impl->pluginAcceptsPixelType(type)) {
+        //YUV420的色度平面紧跟在Y平面之后，I420的色度行距为step/2，逐行紧凑拷贝会打乱色度平面，需要按原行距整体拷贝
+        if(type == PixelType::Pixel_NV12 || type == PixelType::Pixel_NV21 || type == PixelType::Pixel_I420) {
+            auto copied = std::make_shared<std::vector<unsigned char>>(data, data + static_cast<size_t>(height * 3 / 2) * step);
+            return impl->pluginImpl->setMatrixBorrowed(height, width, copied->data(), step, type, copied);
+        }
+
+        auto copied = std::make_shared<cv::Mat>(wrapMatrix(height, width, data, step, type).clone());
+        return impl->pluginImpl->setMatrixBorrowed(height, width, copied->data, copied->step, type, copied);
+    }
+
+    return impl->setConvertedMatrix(height, width, data, step, type);
+}
+
+bool DeepinOCRDriver::setMatrixBorrowed(int height, int width, unsigned char *data, size_t step, PixelType type, std::function<void()> release)
+{
+    if(!pluginIsLoaded()) {
+        DEEPIN_LOG("you need load a plugin first");
+        return false;
+    }
+
+    //holder销毁时即代表插件不再使用data
+    std::shared_ptr<void> holder;
+    if(release) {
+        holder = std::shared_ptr<void>(nullptr, [release](void *) {
+            release();
+        });
+    }
+
+    if(!impl->checkPixelType(type) || !impl->checkYuvLayout(height, width, step, type)) {
+        return false;
+    }
+
+    if(type == impl->pluginImpl->getPixelType()) {
+        if(impl->pluginVersionAtLeast(0x100100)) {
+            return impl->pluginImpl->setMatrixBorrowed(height, width, data, step, std::move(holder));
+        } else {
+            return impl->pluginImpl->setMatrix(height, width, data, step);
+        }
+    }
+
+    if(impl->pluginAcceptsPixelType(type)) {
+        return impl->pluginImpl->setMatrixBorrowed(height, width, data, step, type, std::move(holder));
+    }
+
+    //格式不被插件接受时需要转换，转换完成后调用方的数据就不再被使用了
+    return impl->setConvertedMatrix(height, width, data, step, type);
+}
+
+bool DeepinOCRDriver::setRecognizeBoxes(const std::vector<TextBox> &boxes)
+{
+    if(!pluginIsLoaded()) {
+        DEEPIN_LOG("you need load a plugin first");
+        return false;
+    }
+
+    if(!impl->pluginVersionAtLeast(0x100500)) {
+        DEEPIN_LOG("current plugin do not support setRecognizeBoxes");
+        return false;
+    }
+
+    return impl->pluginImpl->setRecognizeBoxes(boxes);
+}
+
+bool DeepinOCRDriver::setRegionsOfInterest(const std::vector<ImageRect> &regions)
+{
+    if(!pluginIsLoaded()) {
+        DEEPIN_LOG("you need load a plugin first");
+        return false;
+    }
+
+    if(!impl->pluginVersionAtLeast(0x100600)) {
+        DEEPIN_LOG("current plugin do not support setRegionsOfInterest");
+        return false;
+    }
+
+    return impl->pluginImpl->setRegionsOfInterest(regions);
 }
 
 bool DeepinOCRDriver::setValue(const std::string &key, const std::string &value)
@@ -424,6 +913,77 @@ std::string DeepinOCRDriver::getValue(const std::string &key)
     return impl->pluginImpl->getValue(key);
 }
 
+bool DeepinOCRDriver::setAnalyzeCallbacks(const AnalyzeCallbacks &callbacks)
+{
+    if(!pluginIsLoaded()) {
+        DEEPIN_LOG("you need load a plugin first");
+        return false;
+    }
+
+    if(!impl->pluginVersionAtLeast(0x100900)) {
+        DEEPIN_LOG("current plugin do not support setAnalyzeCallbacks");
+        return false;
+    }
+
+    if(!impl->pluginImpl->setAnalyzeCallbacks(callbacks)) {
+        return false;
+    }
+
+    impl->callbacks = callbacks;
+    return true;
+}
+
+bool DeepinOCRDriver_impl::analyze(unsigned int budgetMs, std::chrono::steady_clock::time_point start, bool &hasBudget)
+{
+    isRunning = true;
+
+    //进程内的识别任务统一排队，超过上限时按优先级等待
+    auto &scheduler = OCRScheduler::instance();
+    queueWaitMs = scheduler.acquire(priority);
+
+    //时间预算通过插件设置项传递，只传递排队之后剩余的时间，插件不支持时完整执行
+    hasBudget = false;
+    if(budgetMs > 0) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        auto remaining = std::max<long long>(1, static_cast<long long>(budgetMs) - elapsed);
+        hasBudget = pluginImpl->setValue("analyzeBudgetMs", std::to_string(remaining));
+    }
+
+    //可让位的任务在检测完成后检查是否有更高优先级的任务在等待，有则让出位置并重新排队
+    bool yieldAtStage = preemptible && pluginVersionAtLeast(0x100900);
+    if(yieldAtStage) {
+        auto wrapped = callbacks;
+        wrapped.onBoxesDetected = [this](const std::vector<TextBox> &boxes) {
+            if(callbacks.onBoxesDetected) {
+                callbacks.onBoxesDetected(boxes);
+            }
+            queueWaitMs += OCRScheduler::instance().yield(priority);
+        };
+        yieldAtStage = pluginImpl->setAnalyzeCallbacks(wrapped);
+    }
+
+    auto result = pluginImpl->analyze();
+
+    if(yieldAtStage) {
+        pluginImpl->setAnalyzeCallbacks(callbacks);
+    }
+    if(hasBudget) {
+        pluginImpl->setValue("analyzeBudgetMs", "0");
+    }
+    scheduler.release();
+
+    //插件不支持结果快照时，在此处生成
+    if(!pluginVersionAtLeast(0x100800)) {
+        auto buffer = std::make_shared<ResultBuffer>();
+        flattenResults(*buffer);
+        std::atomic_store(&snapshot, std::shared_ptr<const ResultBuffer>(std::move(buffer)));
+    }
+
+    isRunning = false;
+
+    return result;
+}
+
 bool DeepinOCRDriver::analyze()
 {
     if(!pluginIsLoaded()) {
@@ -431,12 +991,56 @@ bool DeepinOCRDriver::analyze()
         return false;
     }
 
+    bool hasBudget = false;
+    return impl->analyze(0, std::chrono::steady_clock::now(), hasBudget);
+}
+
+bool DeepinOCRDriver::analyze(unsigned int budgetMs, bool *partial)
+{
+    //排队等待的时间也计入预算
+    auto start = std::chrono::steady_clock::now();
+    if(!pluginIsLoaded()) {
+        DEEPIN_LOG("you need load a plugin first");
+        return false;
+    }
+
+    bool hasBudget = false;
+    auto result = impl->analyze(budgetMs, start, hasBudget);
+
+    if(partial != nullptr) {
+        *partial = hasBudget && impl->pluginImpl->getValue("resultPartial") == "1";
+    }
+
+    return result;
+}
+
+bool DeepinOCRDriver::probeText(float *coverage)
+{
+    if(!pluginIsLoaded()) {
+        DEEPIN_LOG("you need load a plugin first");
+        return false;
+    }
+
     impl->isRunning = true;
+    impl->queueWaitMs = OCRScheduler::instance().acquire(impl->priority);
 
-    auto result = impl->pluginImpl->analyze();
+    float textCoverage = 0.0f;
+    bool result = false;
+    if(impl->pluginVersionAtLeast(0x100400)) {
+        result = impl->pluginImpl->probeText(textCoverage);
+    } else {
+        result = impl->pluginImpl->analyze();
+        textCoverage = result ? 1.0f : 0.0f;
+    }
+
+    OCRScheduler::instance().release();
 
     impl->isRunning = false;
 
+    if(coverage != nullptr) {
+        *coverage = textCoverage;
+    }
+
     return result;
 }
 
@@ -505,4 +1109,132 @@ std::string DeepinOCRDriver::getResultFromBox(size_t index)
     return impl->pluginImpl->getResultFromBox(index);
 }
 
+bool DeepinOCRDriver::getResultView(ResultView &view)
+{
+    if(!pluginIsLoaded()) {
+        DEEPIN_LOG("you need load a plugin first");
+        return false;
+    }
+
+    if(impl->pluginVersionAtLeast(0x100700) && impl->pluginImpl->getResultView(view)) {
+        return true;
+    }
+
+    impl->flattenResults(impl->flatResults);
+    view = impl->flatResults.view();
+    return true;
+}
+
+bool DeepinOCRDriver::getResults(ResultBuffer &buffer)
+{
+    if(!pluginIsLoaded()) {
+        DEEPIN_LOG("you need load a plugin first");
+        return false;
+    }
+
+    ResultView view;
+    if(!impl->pluginVersionAtLeast(0x100700) || !impl->pluginImpl->getResultView(view)) {
+        impl->flattenResults(buffer);
+        return true;
+    }
+
+    buffer.lineQuads.assign(view.lineQuads, view.lineQuads + view.lineCount * 8);
+    buffer.lineAngles.assign(view.lineAngles, view.lineAngles + view.lineCount);
+    buffer.lineTextOffsets.assign(view.lineTextOffsets, view.lineTextOffsets + view.lineCount + 1);
+    buffer.lineCharOffsets.assign(view.lineCharOffsets, view.lineCharOffsets + view.lineCount + 1);
+    buffer.charQuads.assign(view.charQuads, view.charQuads + view.charCount * 8);
+    buffer.text.assign(view.text, view.textSize);
+    return true;
+}
+
+std::shared_ptr<const ResultBuffer> DeepinOCRDriver::getResultSnapshot()
+{
+    if(!pluginIsLoaded()) {
+        DEEPIN_LOG("you need load a plugin first");
+        return nullptr;
+    }
+
+    if(impl->pluginVersionAtLeast(0x100800)) {
+        return impl->pluginImpl->getResultSnapshot();
+    }
+
+    return std::atomic_load(&impl->snapshot);
+}
+
+std::unique_ptr<DeepinOCRDriver> DeepinOCRDriver::createSession()
+{
+    if(!pluginIsLoaded()) {
+        DEEPIN_LOG("you need load a plugin first");
+        return nullptr;
+    }
+
+    if(!impl->pluginVersionAtLeast(0x100A00)) {
+        DEEPIN_LOG("current plugin do not support session");
+        return nullptr;
+    }
+
+    auto sessionPlugin = impl->pluginImpl->createSession();
+    if(sessionPlugin == nullptr) {
+        return nullptr;
+    }
+
+    std::unique_ptr<DeepinOCRDriver> session(new DeepinOCRDriver);
+
+    //会话单独持有一次动态库的引用，创建它的驱动切换插件后会话仍然可用
+    if(impl->dlHandle != nullptr) {
+        auto pluginDlFilePath = impl->pluginInstallDir + impl->pluginName + "/libload.so";
+        session->impl->dlHandle = dlopen(pluginDlFilePath.c_str(), RTLD_LAZY);
+        if(session->impl->dlHandle == nullptr) {
+            DEEPIN_LOG("plugin %s dlopen failed", impl->pluginName.c_str());
+            return nullptr;
+        }
+    }
+
+    session->impl->pluginName = impl->pluginName;
+    session->impl->pluginVersion = impl->pluginVersion;
+    session->impl->unloadPlugin = impl->unloadPlugin;
+    session->impl->sessionPlugin = std::move(sessionPlugin);
+    session->impl->pluginImpl = session->impl->sessionPlugin.get();
+    session->impl->pluginIsLoaded = true;
+
+    return session;
+}
+
+bool DeepinOCRDriver::setPriority(AnalyzePriority priority, bool preemptible)
+{
+    impl->priority = priority;
+    impl->preemptible = preemptible;
+    return true;
+}
+
+double DeepinOCRDriver::getQueueWaitMs() const
+{
+    return impl->queueWaitMs;
+}
+
+bool DeepinOCRDriver::setMaxConcurrentAnalyses(unsigned int n)
+{
+    if(n == 0) {
+        DEEPIN_LOG("max concurrent analyses must be greater than 0");
+        return false;
+    }
+
+    OCRScheduler::instance().setCapacity(n);
+    return true;
+}
+
+void DeepinOCRDriver::getSchedulerStats(uint64_t &analyzeCount, double &totalWaitMs, double &maxWaitMs)
+{
+    auto &scheduler = OCRScheduler::instance();
+    analyzeCount = scheduler.completedCount();
+    totalWaitMs = scheduler.totalWaitMs();
+    maxWaitMs = scheduler.maxWaitMs();
+}
+
+bool DeepinOCRDriver::setThreadBudget(unsigned int n)
+{
+    ThreadBudget::instance().setCapacity(n);
+    return true;
+}
+
 }
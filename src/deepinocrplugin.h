@@ -4,6 +4,8 @@
 
 #include <vector>
 #include <string>
+#include <functional>
+#include <memory>
 
 namespace DeepinOCRPlugin {
 
@@ -21,11 +23,18 @@ public:
     //输入：无
     //输出：插件名称列表，不包括默认插件
     std::vector<std::string> getPluginNames();
+
+    //获取插件目录中清单描述的插件信息，不需要加载插件
+    //输入：pluginName：插件名，manifest：插件清单
+    //输出：插件存在并且有清单时返回true
+    //注意：插件名和清单均有缓存，安装目录或清单文件的修改时间变化后自动更新
+    bool getPluginManifest(const std::string &pluginName, PluginManifest &manifest);
     
     //告知上层应用根据目前的硬件环境推荐用哪几个插件
     //输入：无
-    //输出：推荐使用的插件名，返回为空则表示功能不支持或仅存在默认插件
+    //输出：推荐使用的插件名，本地插件按本机测速结果从快到慢排列，只支持网络的在线插件不测速，排在最后；返回为空则表示功能不支持或仅存在默认插件
     //注意：由于多个插件可能都适合当前环境使用，因此这里采用多输出的方式
+    //第一次调用时会逐个加载插件测速，耗时较长；结果会缓存到插件、硬件发生变化为止
     std::vector<std::string> getBestPluginNames();
     
     //设置加载系统默认的插件，此插件由本二次开发库直接提供
@@ -95,12 +104,41 @@ public:
     //输入：图片路径
     //输出：是否设置成功
     bool setImageFile(const std::string &filePath);
+
+    //设置内存中的已编码图片数据，比如剪贴板或网络中获得的PNG、JPEG数据，省去写临时文件的过程
+    //输入：data：图片文件的完整内容，size：数据长度
+    //输出：是否设置成功
+    bool setImageData(const unsigned char *data, size_t size);
+
+    //设置图片文件描述符，从当前位置读取到文件末尾，可以是普通文件、管道或套接字
+    //输入：fd：文件描述符，由调用方负责关闭
+    //输出：是否设置成功
+    bool setImageFd(int fd);
     
     //设置图像矩阵，因为大部分的图像处理都会涉及OpenCV，因此这个地方直接模仿cv::Mat的构造函数
     //输入：height：矩阵的高，width：矩阵的宽，data：指向矩阵的数据指针，step：矩阵每一行的字节数，type：传入矩阵的数据格式
     //输出：是否设置成功
+    //注意：YUV格式的height和width为图像本身的尺寸且必须为偶数，插件可直接接受的格式不会在此处做全图转换
     bool setMatrix(int height, int width, unsigned char *data, size_t step, PixelType type);
+
+    //设置借用模式的图像矩阵，插件直接读取data指向的内存，省去拷贝
+    //输入：前五个参数同setMatrix，release：插件不再使用data时的回调（可能在其他线程中调用）
+    //输出：是否设置成功
+    //注意：调用方需保证data在analyze返回前（或release被调用前）一直有效，插件最迟会在analyze返回时释放data
+    bool setMatrixBorrowed(int height, int width, unsigned char *data, size_t step, PixelType type, std::function<void()> release = nullptr);
     
+    //设置只识别模式下需要识别的文本框，配合setValue("analyzeMode", "recognize")使用
+    //输入：boxes：文本框列表，坐标基于原图，为空时整张图作为一行识别
+    //输出：是否设置成功
+    //注意：只识别模式下getTextBoxes的结果与boxes一一对应
+    bool setRecognizeBoxes(const std::vector<TextBox> &boxes);
+
+    //设置感兴趣区域，之后的analyze只在这些区域内检测和识别，不需要重新设置图像
+    //输入：regions：区域列表，坐标基于原图，为空时恢复为整张图
+    //输出：是否设置成功
+    //注意：输出的文本框坐标仍基于原图；借用模式的图像在analyze返回后即被释放，重复查询时请使用setMatrix
+    bool setRegionsOfInterest(const std::vector<ImageRect> &regions);
+
     //万能拓展接口
     
     //设置数据
@@ -115,15 +153,35 @@ public:
     
     //执行 OCR 识别
     
+    //设置analyze过程中的逐行回调，检测完成后先输出全部文本框，之后按阅读顺序逐行输出识别结果
+    //输入：callbacks：回调函数，不需要的回调置空即可
+    //输出：是否设置成功
+    //注意：回调可能在插件的工作线程中调用，不支持此功能的插件会返回false
+    bool setAnalyzeCallbacks(const AnalyzeCallbacks &callbacks);
+
     //执行OCR识别（开始分析图片），此处需要实现为阻塞模式
     //输入：无
     //输出：是否识别到文本
     bool analyze();
 
+    //在时间预算内执行OCR识别，超时后尽快返回已经识别完成的部分结果
+    //输入：budgetMs：时间预算，单位为毫秒，为0时不限制；partial：可选，输出结果是否不完整
+    //输出：是否识别到文本
+    //注意：预算从调用时开始计算，包括排队等待和模型加载的时间；超时的判断粒度为一次推理，实际耗时可能略超过预算；不支持此功能的插件会完整执行analyze
+    bool analyze(unsigned int budgetMs, bool *partial = nullptr);
+
+    //快速判断图片中是否可能含有文字，适用于批量筛选图片，只对可能含有文字的图片再执行analyze
+    //输入：coverage：可选，输出文字区域占整张图的大致比例，范围为0~1
+    //输出：是否可能含有文字
+    //注意：不支持此功能的插件会退化为完整的analyze，此时coverage只会为0或1
+    bool probeText(float *coverage = nullptr);
+
     //终止OCR识别，此处会由另外一个线程发起，需要插件设计者考虑线程安全
     //但部分场景可能无法或不好实现终止（比如在线识别），因此该接口为选择性实现
     //输入：无
     //输出：是否终止成功
+    //注意：推理本身不能中途停止，终止在当前的一次推理（一次检测或一行识别）完成后生效，大图或很长的文本行需要等待较长时间
+    //对终止延迟有要求时使用带时间预算的analyze，剩余时间不够时插件会分块检测、分段识别，缩短单次推理的耗时
     bool breakAnalyze();
     
     //识别进行中
@@ -157,6 +215,63 @@ public:
     //输出：对应文本块的全部字符含义
     std::string getResultFromBox(size_t index);
 
+    //扁平化的识别结果
+
+    //获取扁平化的识别结果视图，不拷贝数据
+    //输入：view：结果视图
+    //输出：是否获取成功
+    //注意：view在下一次执行analyze或卸载插件前有效；不支持此功能的插件由管理器转换一次后输出
+    bool getResultView(ResultView &view);
+
+    //将识别结果填入调用方的缓冲区，缓冲区可以重复使用
+    //输入：buffer：结果缓冲区
+    //输出：是否获取成功
+    bool getResults(ResultBuffer &buffer);
+
+    //获取最近一次analyze的结果快照，可以在下一次analyze执行期间从其他线程读取，不需要加锁
+    //输入：无
+    //输出：结果快照，尚未执行过analyze时返回空指针
+    //注意：快照不可修改，调用方持有期间一直有效，每次analyze完成后的第一次调用会生成新的快照，不调用则没有额外开销
+    //快照的释放代码位于插件中，卸载或切换插件前需要释放全部快照
+    std::shared_ptr<const ResultBuffer> getResultSnapshot();
+
+    //会话
+
+    //创建与当前插件共享模型的会话，会话拥有独立的图像、设置和识别结果，可以和其他会话同时执行analyze
+    //输入：无
+    //输出：会话，用法与DeepinOCRDriver相同，初始设置与当前插件一致；插件不支持时返回空指针
+    //注意：每个会话同一时间只能在一个线程中使用；会话不需要再加载插件，对会话调用loadPlugin会使其成为独立的驱动
+    std::unique_ptr<DeepinOCRDriver> createSession();
+
+    //进程内调度
+
+    //设置当前驱动的识别任务的优先级
+    //输入：priority：优先级；preemptible：是否允许在检测完成后让位给等待中的更高优先级任务
+    //输出：是否设置成功
+    //注意：让位依赖逐行回调，插件不支持setAnalyzeCallbacks时不会让位
+    bool setPriority(AnalyzePriority priority, bool preemptible = false);
+
+    //获取最近一次analyze或probeText的排队等待时间，包括让位后重新排队的时间
+    //输入：无
+    //输出：等待时间，单位为毫秒
+    double getQueueWaitMs() const;
+
+    //设置整个进程中同时执行的识别任务数上限，对全部驱动和会话生效
+    //输入：上限，默认为当前进程可用的CPU数（考虑CPU亲和性和cgroup配额）
+    //输出：是否设置成功
+    static bool setMaxConcurrentAnalyses(unsigned int n);
+
+    //获取整个进程的调度统计
+    //输入：无
+    //输出：analyzeCount：已开始执行的任务数，totalWaitMs：排队等待时间之和，maxWaitMs：单次最长的排队等待时间
+    static void getSchedulerStats(uint64_t &analyzeCount, double &totalWaitMs, double &maxWaitMs);
+
+    //设置整个进程的推理线程预算，默认插件的全部实例和会话在每个推理阶段从中租用线程
+    //输入：总线程数，为0时使用当前可用的CPU数
+    //输出：是否设置成功
+    //注意：并发推理时各实例实际使用的线程数会少于setUseMaxThreadsCount设置的值
+    static bool setThreadBudget(unsigned int n);
+
 private:
     DeepinOCRDriver_impl *impl;
 };
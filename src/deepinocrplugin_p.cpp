@@ -92,4 +92,89 @@ std::vector<TextBox> Plugin::getCharBoxes(size_t index)
     return std::vector<TextBox>();
 }
 
+bool Plugin::setMatrixBorrowed(int height, int width, unsigned char *data, size_t step, std::shared_ptr<void> holder)
+{
+    //默认退化为拷贝模式，拷贝完成后holder随之释放
+    (void)holder;
+    return setMatrix(height, width, data, step);
+}
+
+std::vector<PixelType> Plugin::getPixelTypeSupportList()
+{
+    return {getPixelType()};
+}
+
+bool Plugin::setMatrixBorrowed(int height, int width, unsigned char *data, size_t step, PixelType type, std::shared_ptr<void> holder)
+{
+    if(type != getPixelType()) {
+        DEEPIN_LOG("current plugin do not implement this function: %s", __FUNCTION__);
+        return false;
+    }
+
+    return setMatrixBorrowed(height, width, data, step, std::move(holder));
+}
+
+bool Plugin::setImageData(const unsigned char *data, size_t size)
+{
+    (void)data;
+    (void)size;
+    DEEPIN_LOG("current plugin do not implement this function: %s", __FUNCTION__);
+
+    return false;
+}
+
+bool Plugin::probeText(float &coverage)
+{
+    auto result = analyze();
+    coverage = result ? 1.0f : 0.0f;
+
+    return result;
+}
+
+bool Plugin::setRecognizeBoxes(const std::vector<TextBox> &boxes)
+{
+    (void)boxes;
+    DEEPIN_LOG("current plugin do not implement this function: %s", __FUNCTION__);
+
+    return false;
+}
+
+bool Plugin::setRegionsOfInterest(const std::vector<ImageRect> &regions)
+{
+    (void)regions;
+    DEEPIN_LOG("current plugin do not implement this function: %s", __FUNCTION__);
+
+    return false;
+}
+
+bool Plugin::getResultView(ResultView &view)
+{
+    (void)view;
+    DEEPIN_LOG("current plugin do not implement this function: %s", __FUNCTION__);
+
+    return false;
+}
+
+std::shared_ptr<const ResultBuffer> Plugin::getResultSnapshot()
+{
+    DEEPIN_LOG("current plugin do not implement this function: %s", __FUNCTION__);
+
+    return nullptr;
+}
+
+bool Plugin::setAnalyzeCallbacks(const AnalyzeCallbacks &callbacks)
+{
+    (void)callbacks;
+    DEEPIN_LOG("current plugin do not implement this function: %s", __FUNCTION__);
+
+    return false;
+}
+
+std::shared_ptr<Plugin> Plugin::createSession()
+{
+    DEEPIN_LOG("current plugin do not implement this function: %s", __FUNCTION__);
+
+    return nullptr;
+}
+
 }
@@ -4,6 +4,7 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 #include <initializer_list>
 
 //插件加载接口，用于加载插件的基础类
@@ -148,6 +149,93 @@ public:
     //输入：文本块的编号，和textBoxes成员函数输出的vector一一对应
     //输出：对应文本块的全部字符含义
     virtual std::string getResultFromBox(size_t index) = 0;
+
+    //以下为后续版本新增的接口，为保证已编译插件的二进制兼容，新接口只能追加在末尾
+    //管理器会根据pluginVersion的返回值判断插件是否实现了这些接口
+
+    //0x100100版本新增
+
+    //设置借用模式的图像矩阵，插件直接引用data指向的内存而不进行拷贝
+    //输入：height、width、data、step：同setMatrix，holder：data的持有者，插件不再使用data时释放holder即可
+    //输出：是否设置成功
+    //注意：插件最迟需要在analyze返回时释放holder；未实现此接口的插件将退化为setMatrix的拷贝模式
+    virtual bool setMatrixBorrowed(int height, int width, unsigned char *data, size_t step, std::shared_ptr<void> holder);
+
+    //0x100200版本新增
+
+    //获取插件可以直接接受的全部图像数据格式
+    //输入：无
+    //输出：支持的图像数据格式列表，默认只包含getPixelType的返回值
+    //注意：对于列表中的格式，管理器不再做全图的格式转换，而是原样交给插件
+    virtual std::vector<PixelType> getPixelTypeSupportList();
+
+    //设置借用模式的图像矩阵，并告知插件数据的格式
+    //输入：type：图像数据格式，取值为getPixelTypeSupportList中的一项，其余参数同上
+    //输出：是否设置成功
+    virtual bool setMatrixBorrowed(int height, int width, unsigned char *data, size_t step, PixelType type, std::shared_ptr<void> holder);
+
+    //0x100300版本新增
+
+    //设置内存中的已编码图片数据，格式与getImageFileSupportFormats一致
+    //输入：data：图片文件的完整内容，size：数据长度
+    //输出：是否设置成功
+    //注意：该接口返回后data即可被调用方释放
+    virtual bool setImageData(const unsigned char *data, size_t size);
+
+    //0x100400版本新增
+
+    //快速判断图片中是否可能含有文字，只做低分辨率的检测，不做识别，不影响之后的analyze
+    //输入：无
+    //输出：是否可能含有文字，coverage：文字区域占整张图的大致比例，范围为0~1
+    //注意：未实现此接口的插件将退化为analyze
+    virtual bool probeText(float &coverage);
+
+    //0x100500版本新增
+
+    //设置只识别模式下需要识别的文本框，坐标基于原图
+    //输入：boxes：文本框列表，为空时整张图作为一行识别
+    //输出：是否设置成功
+    //注意：只识别模式下getTextBoxes的结果与boxes一一对应，未识别到文字的文本框结果为空
+    virtual bool setRecognizeBoxes(const std::vector<TextBox> &boxes);
+
+    //0x100600版本新增
+
+    //设置感兴趣区域，之后的analyze只在这些区域内检测和识别，输出的坐标仍基于原图
+    //输入：regions：区域列表，坐标基于原图，为空时恢复为整张图
+    //输出：是否设置成功
+    //注意：区域设置后一直有效，更换图像时不会自动清除
+    virtual bool setRegionsOfInterest(const std::vector<ImageRect> &regions);
+
+    //0x100700版本新增
+
+    //获取扁平化的识别结果
+    //输入：view：结果视图
+    //输出：是否获取成功
+    //注意：view中的指针指向插件内部的数据，在下一次执行analyze或卸载插件前有效
+    virtual bool getResultView(ResultView &view);
+
+    //0x100800版本新增
+
+    //获取最近一次analyze的结果快照，快照不可修改，在持有期间一直有效
+    //输入：无
+    //输出：结果快照，不支持时返回空指针
+    //注意：该接口可能在analyze执行期间由其他线程调用，插件需要保证线程安全
+    virtual std::shared_ptr<const ResultBuffer> getResultSnapshot();
+
+    //0x100900版本新增
+
+    //设置analyze过程中的逐行回调
+    //输入：callbacks：回调函数，不需要的回调置空即可
+    //输出：是否设置成功
+    virtual bool setAnalyzeCallbacks(const AnalyzeCallbacks &callbacks);
+
+    //0x100A00版本新增
+
+    //创建与当前插件共享模型的会话，会话拥有独立的图像、设置和识别结果
+    //输入：无
+    //输出：新的会话，初始设置与当前插件一致，不支持时返回空指针
+    //注意：不同会话可以在不同线程中同时执行analyze，插件需要保证共享的模型线程安全
+    virtual std::shared_ptr<Plugin> createSession();
 };
 
 }
@@ -1,7 +1,10 @@
 #pragma once
 
 #include <vector>
+#include <string>
 #include <utility>
+#include <cstdint>
+#include <functional>
 
 #define DEEPIN_EXPORTS __attribute__ ((visibility ("default")))
 
@@ -35,7 +38,10 @@ enum class PixelType {
     Pixel_RGB,          //RGB888模式
     Pixel_BGR,          //BGR888模式
     Pixel_RGBA,         //RGBA8888模式
-    Pixel_BGRA          //BGRA8888模式
+    Pixel_BGRA,         //BGRA8888模式
+    Pixel_NV12,         //YUV420SP模式，Y平面之后为UV交错平面，数据共height*3/2行
+    Pixel_NV21,         //YUV420SP模式，Y平面之后为VU交错平面，数据共height*3/2行
+    Pixel_I420          //YUV420P模式，依次为Y、U、V平面，U、V平面每行step/2个字节
 };
 
 struct TextBox {
@@ -46,6 +52,121 @@ struct TextBox {
     float angle;
 };
 
-constexpr int VERSION = 0x100000;
+struct ImageRect {
+    //矩形区域的左上角坐标和尺寸，单位为像素
+    int x;
+    int y;
+    int width;
+    int height;
+};
+
+//扁平化的识别结果视图，全部数据存放在连续的数组中，一次即可获取整张图的结果，不需要逐个拷贝TextBox
+//四边形按4个点的x、y依次存放，每个四边形8个float
+//第i行的文本为text[lineTextOffsets[i], lineTextOffsets[i + 1])，字符为charQuads中[lineCharOffsets[i], lineCharOffsets[i + 1])的四边形
+struct ResultView {
+    uint32_t version;                //结构版本，当前为ResultViewVersion
+    size_t lineCount;                //文本行数
+    const float *lineQuads;          //文本行的四边形，共lineCount * 8个
+    const float *lineAngles;         //文本行的倾斜角度，共lineCount个
+    const uint32_t *lineTextOffsets; //文本行在text中的起始位置，共lineCount + 1个
+    const uint32_t *lineCharOffsets; //文本行的字符在charQuads中的起始编号，共lineCount + 1个
+    size_t charCount;                //字符数
+    const float *charQuads;          //字符的四边形，共charCount * 8个
+    const char *text;                //全部文本行的UTF-8文本，行之间没有分隔符
+    size_t textSize;                 //text的字节数
+};
+
+constexpr uint32_t ResultViewVersion = 1;
+
+//扁平化的识别结果存储，可由调用方持有并重复使用以避免重复分配内存
+struct ResultBuffer {
+    std::vector<float> lineQuads;
+    std::vector<float> lineAngles;
+    std::vector<uint32_t> lineTextOffsets;
+    std::vector<uint32_t> lineCharOffsets;
+    std::vector<float> charQuads;
+    std::string text;
+
+    //清空数据，保留已分配的内存
+    void clear()
+    {
+        lineQuads.clear();
+        lineAngles.clear();
+        lineTextOffsets.assign(1, 0);
+        lineCharOffsets.assign(1, 0);
+        charQuads.clear();
+        text.clear();
+    }
+
+    //追加一个四边形
+    static void appendQuad(std::vector<float> &quads, const TextBox &box)
+    {
+        for(size_t i = 0; i != 4; ++i) {
+            quads.push_back(i < box.points.size() ? box.points[i].first : 0.0f);
+            quads.push_back(i < box.points.size() ? box.points[i].second : 0.0f);
+        }
+    }
+
+    //追加一个文本行，字符四边形需要在此之前追加到charQuads中
+    void appendLine(const TextBox &box, const std::string &lineText)
+    {
+        appendQuad(lineQuads, box);
+        lineAngles.push_back(box.angle);
+        text += lineText;
+        lineTextOffsets.push_back(static_cast<uint32_t>(text.size()));
+        lineCharOffsets.push_back(static_cast<uint32_t>(charQuads.size() / 8));
+    }
+
+    //生成视图，视图在ResultBuffer被修改或销毁前有效
+    ResultView view() const
+    {
+        ResultView result;
+        result.version = ResultViewVersion;
+        result.lineCount = lineAngles.size();
+        result.lineQuads = lineQuads.data();
+        result.lineAngles = lineAngles.data();
+        result.lineTextOffsets = lineTextOffsets.data();
+        result.lineCharOffsets = lineCharOffsets.data();
+        result.charCount = charQuads.size() / 8;
+        result.charQuads = charQuads.data();
+        result.text = text.data();
+        result.textSize = text.size();
+        return result;
+    }
+};
+
+//analyze过程中的逐行回调，坐标基于原图
+//回调可能在插件的工作线程中调用，但同一时刻只会有一个回调在执行
+struct AnalyzeCallbacks {
+    //检测和排序完成后调用一次，输入为按阅读顺序排列的全部文本框
+    std::function<void(const std::vector<TextBox> &boxes)> onBoxesDetected;
+
+    //文本行识别完成后调用，按阅读顺序依次调用，index为onBoxesDetected中文本框的编号
+    //未识别到文字的文本行也会回调（text为空），这些文本行不会出现在analyze的最终结果中
+    std::function<void(size_t index, const std::string &text, const std::vector<TextBox> &charBoxes)> onLineRecognized;
+};
+
+//插件的清单，来自插件目录中的manifest.conf，不需要加载插件即可获取
+//manifest.conf的每一行为"键=值"，以#开头的行为注释，列表项之间以逗号分隔，例如：
+//version=0x100A00
+//hardware=CPU_Any,GPU_Vulkan
+//languages=zh-Hans_en,en
+//formats=png,jpg
+//hardware的取值为HardwareID中各项的名字，清单中没有的项为空
+struct PluginManifest {
+    int version = 0;
+    std::vector<HardwareID> hardware;
+    std::vector<std::string> languages;
+    std::vector<std::string> imageFormats;
+};
+
+//analyze的优先级，用于进程内的调度
+//同一进程中同时执行的识别任务超过上限时，高优先级的任务先执行，同一优先级内按提交顺序执行
+enum class AnalyzePriority {
+    Interactive = 0, //交互请求，例如截图识别
+    Background       //后台任务，例如批量建立索引
+};
+
+constexpr int VERSION = 0x100A00;
 
 }
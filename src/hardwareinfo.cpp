@@ -0,0 +1,127 @@
+#include "hardwareinfo.h"
+
+#include <ncnn/cpu.h>
+#include <ncnn/gpu.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include <dirent.h>
+#include <string.h>
+
+namespace DeepinOCRPlugin {
+
+//读取/proc/cpuinfo中第一个匹配的字段
+static std::string cpuInfoField(const std::string &field)
+{
+    std::ifstream fs("/proc/cpuinfo");
+    std::string line;
+    while(std::getline(fs, line)) {
+        if(line.compare(0, field.size(), field) == 0) {
+            size_t pos = line.find(':');
+            if(pos != std::string::npos) {
+                size_t begin = line.find_first_not_of(" \t", pos + 1);
+                return begin == std::string::npos ? "" : line.substr(begin);
+            }
+        }
+    }
+    return "";
+}
+
+//PCI厂商编号与GPU类型的对应关系
+static HardwareID gpuFromPciVendor(unsigned int vendor)
+{
+    switch (vendor) {
+    case 0x10de:
+        return HardwareID::GPU_NVIDIA;
+    case 0x1002:
+        return HardwareID::GPU_AMD;
+    case 0x1ed5:
+        return HardwareID::GPU_MT;
+    case 0x0731:
+        return HardwareID::GPU_JM;
+    case 0x0014:
+        return HardwareID::GPU_Loongson;
+    default:
+        return HardwareID::GPU_Any;
+    }
+}
+
+std::vector<HardwareID> detectHardware()
+{
+    std::vector<HardwareID> result = {HardwareID::CPU_Any, HardwareID::Network};
+
+    //CPU平台由编译目标决定，x86平台再区分厂商
+#if defined(__x86_64__) || defined(__i386__)
+    std::string vendor = cpuInfoField("vendor_id");
+    if(vendor == "GenuineIntel") {
+        result.push_back(HardwareID::CPU_Intel);
+    } else if(vendor == "AuthenticAMD") {
+        result.push_back(HardwareID::CPU_AMD);
+    }
+#elif defined(__aarch64__)
+    result.push_back(HardwareID::CPU_AArch64);
+#elif defined(__mips__)
+    result.push_back(HardwareID::CPU_MIPS);
+#elif defined(_loongarch) || defined(__loongarch__) || defined(__loongarch64)
+    result.push_back(HardwareID::CPU_LoongArch);
+#elif defined(__sw_64__)
+    result.push_back(HardwareID::CPU_SW);
+#endif
+
+    //显示设备的PCI厂商编号，不需要初始化GPU驱动
+    DIR *dir = opendir("/sys/class/drm");
+    if(dir != nullptr) {
+        struct dirent *ptr;
+        while((ptr = readdir(dir)) != nullptr) {
+            if(strncmp(ptr->d_name, "card", 4) != 0 || strchr(ptr->d_name, '-') != nullptr) { //跳过card0-HDMI-A-1这类接口
+                continue;
+            }
+            std::ifstream fs(std::string("/sys/class/drm/") + ptr->d_name + "/device/vendor");
+            unsigned int vendorId = 0;
+            if(fs >> std::hex >> vendorId) {
+                result.push_back(HardwareID::GPU_Any);
+                result.push_back(gpuFromPciVendor(vendorId));
+            }
+        }
+        closedir(dir);
+    }
+
+    //可用的Vulkan设备
+    if(ncnn::get_gpu_count() > 0) {
+        result.push_back(HardwareID::GPU_Any);
+        result.push_back(HardwareID::GPU_Vulkan);
+    }
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+std::string cpuFeatures()
+{
+    std::vector<std::string> features;
+#if defined(__x86_64__) || defined(__i386__)
+    if(ncnn::cpu_support_x86_avx2()) {
+        features.push_back("avx2");
+    }
+    if(ncnn::cpu_support_x86_avx()) {
+        features.push_back("avx");
+    }
+#elif defined(__aarch64__) || defined(__arm__)
+    if(ncnn::cpu_support_arm_asimdhp()) {
+        features.push_back("asimdhp");
+    }
+    if(ncnn::cpu_support_arm_neon()) {
+        features.push_back("neon");
+    }
+#endif
+
+    std::string result;
+    for(auto &feature : features) {
+        result += (result.empty() ? "" : ",") + feature;
+    }
+    return result;
+}
+
+}
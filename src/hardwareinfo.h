@@ -0,0 +1,17 @@
+#pragma once
+
+#include "deepinocrplugindef.h"
+
+#include <string>
+#include <vector>
+
+namespace DeepinOCRPlugin {
+
+//检测当前环境可用的硬件，包括CPU平台和厂商、GPU厂商以及Vulkan设备
+//输出的列表总是包含CPU_Any和Network
+std::vector<HardwareID> detectHardware();
+
+//当前CPU支持的指令集扩展，例如"avx2,avx"，用于区分调优和测速结果
+std::string cpuFeatures();
+
+}
@@ -0,0 +1,117 @@
+#include "ocrscheduler.h"
+#include "toolkits.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace DeepinOCRPlugin {
+
+OCRScheduler &OCRScheduler::instance()
+{
+    static OCRScheduler scheduler;
+    return scheduler;
+}
+
+OCRScheduler::OCRScheduler()
+{
+    maxRunning = getAvailableCpuCount();
+}
+
+void OCRScheduler::setCapacity(unsigned int n)
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    maxRunning = std::max(1u, n);
+    cond.notify_all();
+}
+
+unsigned int OCRScheduler::capacity() const
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    return maxRunning;
+}
+
+bool OCRScheduler::higherPriorityWaiting(AnalyzePriority priority) const
+{
+    for(int i = 0; i < static_cast<int>(priority); ++i) {
+        if(!queues[i].empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+double OCRScheduler::acquire(AnalyzePriority priority)
+{
+    return acquireSlot(priority, true);
+}
+
+double OCRScheduler::acquireSlot(AnalyzePriority priority, bool countStats)
+{
+    auto begin = std::chrono::steady_clock::now();
+    auto &queue = queues[static_cast<int>(priority)];
+
+    std::unique_lock<std::mutex> locker(mutex);
+    uint64_t ticket = nextTicket++;
+    queue.push_back(ticket);
+
+    //轮到自己的条件：有空闲位置、排在同一优先级的最前面、没有更高优先级的任务在等待
+    cond.wait(locker, [&]() {
+        return running < maxRunning && queue.front() == ticket && !higherPriorityWaiting(priority);
+    });
+    queue.pop_front();
+    ++running;
+
+    double waitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    if(countStats) {
+        ++completed;
+        waitSum += waitMs;
+        waitMax = std::max(waitMax, waitMs);
+    }
+
+    //后面的任务可能也可以执行了
+    cond.notify_all();
+    return waitMs;
+}
+
+void OCRScheduler::release()
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    if(running > 0) {
+        --running;
+    }
+    cond.notify_all();
+}
+
+double OCRScheduler::yield(AnalyzePriority priority)
+{
+    {
+        std::lock_guard<std::mutex> locker(mutex);
+        if(!higherPriorityWaiting(priority)) {
+            return 0;
+        }
+    }
+
+    //让位后重新排队的仍是同一个任务，不计入进程的调度统计
+    release();
+    return acquireSlot(priority, false);
+}
+
+uint64_t OCRScheduler::completedCount() const
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    return completed;
+}
+
+double OCRScheduler::totalWaitMs() const
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    return waitSum;
+}
+
+double OCRScheduler::maxWaitMs() const
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    return waitMax;
+}
+
+}
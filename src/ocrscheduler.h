@@ -0,0 +1,57 @@
+#pragma once
+
+#include "deepinocrplugindef.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+
+namespace DeepinOCRPlugin {
+
+//进程内全部识别任务的调度器，限制同时执行的识别任务数
+//等待中的任务按优先级执行，同一优先级内先到先执行
+class OCRScheduler
+{
+public:
+    static OCRScheduler &instance();
+
+    //同时执行的识别任务数上限，默认为当前进程可用的CPU数
+    void setCapacity(unsigned int n);
+    unsigned int capacity() const;
+
+    //等待直到可以执行，返回排队等待的时间，单位为毫秒
+    double acquire(AnalyzePriority priority);
+
+    //执行完成，让出位置
+    void release();
+
+    //在识别的阶段之间调用：有更高优先级的任务在等待时让出位置，重新排队后继续执行
+    //返回因让出而等待的时间，单位为毫秒，没有让出时返回0
+    double yield(AnalyzePriority priority);
+
+    //调度统计，yield中重新排队的等待不计入
+    uint64_t completedCount() const; //完成排队的任务数
+    double totalWaitMs() const;      //全部任务的排队等待时间之和
+    double maxWaitMs() const;        //单个任务的最长排队等待时间
+
+private:
+    OCRScheduler();
+
+    bool higherPriorityWaiting(AnalyzePriority priority) const; //调用前需要持有锁
+    double acquireSlot(AnalyzePriority priority, bool countStats); //countStats为false时不更新调度统计
+
+    static constexpr int PriorityCount = 2;
+
+    mutable std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<uint64_t> queues[PriorityCount]; //各优先级等待中的任务
+    uint64_t nextTicket = 0;
+    unsigned int running = 0;
+    unsigned int maxRunning = 1;
+    uint64_t completed = 0;
+    double waitSum = 0;
+    double waitMax = 0;
+};
+
+}
@@ -0,0 +1,349 @@
+/*
+* Copyright (C) 2020 ~ 2022 Deepin Technology Co., Ltd.
+*
+* Author: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* Maintainer: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "autotune.h"
+#include "reccache.h"
+
+#include <toolkits.h>
+
+#include <ncnn/net.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+
+#include <unistd.h>
+
+//各尺寸分类的合成图像长边，以及需要识别的文本行数
+static constexpr int ClassSides[TuneResult::SizeClassCount] = {640, 1280, 1920};
+static constexpr int ClassLines[TuneResult::SizeClassCount] = {4, 16, 48};
+
+//合成文本行的尺寸，与识别网络的输入一致，高度固定为32
+static constexpr int LineWidth = 320;
+static constexpr int LineHeight = 32;
+
+//每个候选配置预热一次后测量的次数，取最短时间
+static constexpr int MeasureRounds = 2;
+
+int AutoTuner::sizeClass(const cv::Size &size)
+{
+    int side = std::max(size.width, size.height);
+    for(int i = 0; i < TuneResult::SizeClassCount - 1; ++i) {
+        if(side <= ClassSides[i]) {
+            return i;
+        }
+    }
+    return TuneResult::SizeClassCount - 1;
+}
+
+std::string AutoTuner::machineKey()
+{
+    //x86和龙芯为model name，ARM平台为CPU implementer和CPU part
+    std::ifstream fs("/proc/cpuinfo");
+    std::string line;
+    std::string model;
+    while(std::getline(fs, line)) {
+        if(line.compare(0, 10, "model name") == 0 || line.compare(0, 15, "CPU implementer") == 0
+                || line.compare(0, 8, "CPU part") == 0) {
+            size_t pos = line.find(':');
+            if(pos != std::string::npos && model.find(line.substr(pos + 1)) == std::string::npos) {
+                model += line.substr(pos + 1);
+            }
+        }
+        if(line.empty() && !model.empty()) { //只取第一个CPU的信息
+            break;
+        }
+    }
+
+    return model + "|" + std::to_string(getAvailableCpuCount());
+}
+
+std::string AutoTuner::resultPath()
+{
+    std::string cacheDir = getUserCacheDir();
+    if(cacheDir.empty()) {
+        return "";
+    }
+
+    std::string key = machineKey();
+    char name[32];
+    snprintf(name, sizeof(name), "autotune-%016llx.conf",
+             static_cast<unsigned long long>(hashBytes(reinterpret_cast<const unsigned char *>(key.data()), key.size())));
+    return cacheDir + "/paddleocr-ncnn/" + name;
+}
+
+bool AutoTuner::load(TuneResult &result)
+{
+    std::string path = resultPath();
+    std::ifstream fs(path);
+    if(path.empty() || !fs.is_open()) {
+        return false;
+    }
+
+    //文件中的每一行为"键=值"，机器标识不一致时（例如修改了CPU配额）视为无效
+    TuneResult loaded;
+    std::string line;
+    bool machineMatched = false;
+    int threadsFound = 0;
+    while(std::getline(fs, line)) {
+        size_t pos = line.find('=');
+        if(pos == std::string::npos) {
+            continue;
+        }
+        std::string key = line.substr(0, pos);
+        std::string value = line.substr(pos + 1);
+        if(key == "machine") {
+            machineMatched = value == machineKey();
+        } else if(key == "options" && value.size() == 4) {
+            loaded.options.lightmode = value[0] == '1';
+            loaded.options.winograd = value[1] == '1';
+            loaded.options.sgemm = value[2] == '1';
+            loaded.options.packing = value[3] == '1';
+        } else if(key.compare(0, 7, "threads") == 0) {
+            int index = atoi(key.c_str() + 7);
+            unsigned int det = 0;
+            unsigned int rec = 0;
+            if(index >= 0 && index < TuneResult::SizeClassCount && sscanf(value.c_str(), "%u,%u", &det, &rec) == 2 && det > 0 && rec > 0) {
+                loaded.detThreads[index] = det;
+                loaded.recThreads[index] = rec;
+                ++threadsFound;
+            }
+        }
+    }
+
+    if(!machineMatched || threadsFound != TuneResult::SizeClassCount) {
+        return false;
+    }
+
+    loaded.valid = true;
+    result = loaded;
+    return true;
+}
+
+bool AutoTuner::save(const TuneResult &result)
+{
+    std::string path = resultPath();
+    if(path.empty()) {
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), error);
+
+    //先写入临时文件再重命名，避免其他进程读到写了一半的文件
+    std::string tempPath = path + ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream fs(tempPath, std::ios::trunc);
+        if(!fs.is_open()) {
+            DEEPIN_LOG("cannot write autotune result: %s", tempPath.c_str());
+            return false;
+        }
+        fs << "machine=" << machineKey() << "\n";
+        fs << "options=" << result.options.key() << "\n";
+        for(int i = 0; i < TuneResult::SizeClassCount; ++i) {
+            fs << "threads" << i << "=" << result.detThreads[i] << "," << result.recThreads[i] << "\n";
+        }
+    }
+
+    std::filesystem::rename(tempPath, path, error);
+    if(error) {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
+//合成的待识别图像：白底上的若干黑色横条，模拟文本行
+static cv::Mat syntheticImage(int width, int height)
+{
+    cv::Mat image(height, width, CV_8UC3, cv::Scalar(255, 255, 255));
+    for(int y = 16; y + 24 < height; y += 48) {
+        image.rowRange(y, y + 16).colRange(width / 16, width - width / 8).setTo(cv::Scalar(0, 0, 0));
+    }
+    return image;
+}
+
+//测量一个函数的耗时，预热一次后取最短时间，单位为毫秒
+static double measure(const std::function<void()> &func)
+{
+    func();
+    double best = 0;
+    for(int i = 0; i < MeasureRounds; ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        func();
+        double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        best = i == 0 ? elapsed : std::min(best, elapsed);
+    }
+    return best;
+}
+
+//检测一张合成图像
+static void runDetect(const OCRModels &models, const cv::Mat &image, unsigned int threads)
+{
+    ncnn::Mat input = ncnn::Mat::from_pixels(image.data, ncnn::Mat::PIXEL_BGR2RGB, image.cols, image.rows);
+    ncnn::Extractor extractor = models.detNet->create_extractor();
+    extractor.set_num_threads(static_cast<int>(threads));
+    extractor.input(0, input);
+    ncnn::Mat out;
+    extractor.extract(models.detNet->output_indexes()[0], out);
+}
+
+//与识别时相同的方式，多个文本行并行识别，每个Extractor单线程
+static void runRecognize(const OCRModels &models, const cv::Mat &line, int lines, unsigned int threads)
+{
+    auto outIndexes = models.recNet->output_indexes();
+    #pragma omp parallel for num_threads(threads) schedule(dynamic)
+    for(int i = 0; i < lines; ++i) {
+        ncnn::Mat input = ncnn::Mat::from_pixels(line.data, ncnn::Mat::PIXEL_RGB, line.cols, line.rows);
+        ncnn::Extractor extractor = models.recNet->create_extractor();
+        extractor.set_vulkan_compute(false);
+        extractor.input(0, input);
+        ncnn::Mat out;
+        extractor.extract(outIndexes[outIndexes.size() - 1], out);
+    }
+}
+
+//候选的线程数：1、2、4……直到上限，上限本身也参与测量
+static std::vector<unsigned int> threadCandidates(unsigned int maxThreads)
+{
+    std::vector<unsigned int> result;
+    for(unsigned int n = 1; n < maxThreads; n *= 2) {
+        result.push_back(n);
+    }
+    result.push_back(maxThreads);
+    return result;
+}
+
+TuneResult AutoTuner::run(const std::function<std::shared_ptr<const OCRModels>(const NetOptions &)> &loadModels,
+                          int detectSide, unsigned int maxThreads)
+{
+    TuneResult result;
+    maxThreads = std::max(1u, maxThreads);
+
+    //检测网络的输入不超过detectSide，各尺寸分类按4:3的比例合成，边长对齐到32
+    cv::Mat images[TuneResult::SizeClassCount];
+    for(int i = 0; i < TuneResult::SizeClassCount; ++i) {
+        int side = std::max(32, std::min(ClassSides[i], detectSide) / 32 * 32);
+        images[i] = syntheticImage(side, std::max(32, side * 3 / 4 / 32 * 32));
+    }
+    cv::Mat line = syntheticImage(LineWidth, LineHeight);
+
+    //网络选项：以ncnn的默认值为基准，每次关闭一项，在中等尺寸上比较检测和识别的总耗时
+    std::vector<NetOptions> candidates(5);
+    candidates[1].lightmode = false;
+    candidates[2].winograd = false;
+    candidates[3].sgemm = false;
+    candidates[4].packing = false;
+
+    const int middle = TuneResult::SizeClassCount / 2;
+    double bestTime = -1;
+    std::shared_ptr<const OCRModels> bestModels;
+    for(auto &candidate : candidates) {
+        auto models = loadModels(candidate);
+        if(models == nullptr) {
+            continue;
+        }
+        double elapsed = measure([&]() {
+            runDetect(*models, images[middle], maxThreads);
+            runRecognize(*models, line, ClassLines[middle], maxThreads);
+        });
+        DEEPIN_LOG("autotune options %s: %.1f ms", candidate.key().c_str(), elapsed);
+        if(bestTime < 0 || elapsed < bestTime) {
+            bestTime = elapsed;
+            result.options = candidate;
+            bestModels = models;
+        }
+    }
+
+    if(bestModels == nullptr) {
+        return result;
+    }
+
+    //线程数：检测和识别分别测量，检测为单次推理，识别为多行并行
+    auto threads = threadCandidates(maxThreads);
+    for(int i = 0; i < TuneResult::SizeClassCount; ++i) {
+        double bestDet = -1;
+        double bestRec = -1;
+        for(auto n : threads) {
+            double det = measure([&]() {
+                runDetect(*bestModels, images[i], n);
+            });
+            double rec = measure([&]() {
+                runRecognize(*bestModels, line, ClassLines[i], n);
+            });
+
+            //线程数多而收益不足5%时选择更少的线程，给其他任务留出CPU
+            if(bestDet < 0 || det < bestDet * 0.95) {
+                bestDet = det;
+                result.detThreads[i] = n;
+            }
+            if(bestRec < 0 || rec < bestRec * 0.95) {
+                bestRec = rec;
+                result.recThreads[i] = n;
+            }
+        }
+        DEEPIN_LOG("autotune size class %d: det %u threads, rec %u threads", i, result.detThreads[i], result.recThreads[i]);
+    }
+
+    result.valid = true;
+    return result;
+}
+
+//进程内共享的调优结果
+static std::mutex sharedMutex;
+static TuneResult sharedResult;
+static bool sharedReady = false;
+static bool rerunRequested = false;
+
+TuneResult AutoTuner::acquire(const std::function<std::shared_ptr<const OCRModels>(const NetOptions &)> &loadModels,
+                              int detectSide, unsigned int maxThreads)
+{
+    std::lock_guard<std::mutex> locker(sharedMutex);
+    if(sharedReady) {
+        return sharedResult;
+    }
+
+    if(!rerunRequested && load(sharedResult)) {
+        sharedReady = true;
+        return sharedResult;
+    }
+    rerunRequested = false;
+
+    DEEPIN_LOG("autotune start");
+    sharedResult = run(loadModels, detectSide, maxThreads);
+    if(sharedResult.valid && !save(sharedResult)) {
+        DEEPIN_LOG("autotune result save failed");
+    }
+
+    //调优失败时也不再重试，避免每个会话都重新测量
+    sharedReady = true;
+    return sharedResult;
+}
+
+void AutoTuner::requestRerun()
+{
+    std::lock_guard<std::mutex> locker(sharedMutex);
+    rerunRequested = true;
+    sharedReady = false;
+}
@@ -0,0 +1,72 @@
+/*
+* Copyright (C) 2020 ~ 2022 Deepin Technology Co., Ltd.
+*
+* Author: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* Maintainer: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <ocrmodels.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+//自动调优的结果：一组网络选项，以及各尺寸分类下检测和识别的线程数
+struct TuneResult {
+    static constexpr int SizeClassCount = 3;
+
+    bool valid = false;
+    NetOptions options;
+    unsigned int detThreads[SizeClassCount] = {1, 1, 1};
+    unsigned int recThreads[SizeClassCount] = {1, 1, 1};
+};
+
+//在合成输入上测量候选的ncnn选项和线程数，按机器保存最快的配置
+//不同机器（CPU型号、可用CPU数）的结果分别保存在用户缓存目录中
+class AutoTuner
+{
+public:
+    //图像的尺寸分类：长边不超过640、不超过1280、更大
+    static int sizeClass(const cv::Size &size);
+
+    //本机的标识，由CPU型号和可用CPU数组成
+    static std::string machineKey();
+
+    //本机调优结果的保存路径，获取缓存目录失败时返回空字符串
+    static std::string resultPath();
+
+    //读取和保存本机的调优结果
+    static bool load(TuneResult &result);
+    static bool save(const TuneResult &result);
+
+    //执行调优：先在中等尺寸上选出网络选项，再为每个尺寸分类选出检测和识别的线程数
+    //loadModels：按选项加载模型，detectSide：检测时长边的最大尺寸，maxThreads：线程数上限
+    static TuneResult run(const std::function<std::shared_ptr<const OCRModels>(const NetOptions &)> &loadModels,
+                          int detectSide, unsigned int maxThreads);
+
+    //获取进程内共享的调优结果：第一次调用时读取本机保存的结果，没有时执行调优，之后直接返回
+    //同一进程只调优一次，同时调用的其他会话等待调优完成后复用结果，参数同run
+    static TuneResult acquire(const std::function<std::shared_ptr<const OCRModels>(const NetOptions &)> &loadModels,
+                              int detectSide, unsigned int maxThreads);
+
+    //忽略已保存的结果，下一次acquire时重新调优
+    static void requestRerun();
+};
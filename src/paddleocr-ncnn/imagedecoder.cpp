@@ -0,0 +1,667 @@
+/*
+* Copyright (C) 2020 ~ 2022 Deepin Technology Co., Ltd.
+*
+* Author: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* Maintainer: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "imagedecoder.h"
+
+#include <toolkits.h>
+
+#include <algorithm>
+#include <climits>
+#include <cctype>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef HAVE_LIBJPEG
+#include <cstdio>
+#include <csetjmp>
+#include <jpeglib.h>
+#endif
+
+#ifdef HAVE_LIBSPNG
+#include <spng.h>
+#endif
+
+//PGM、PPM：未压缩格式，提供了dataHolder时直接引用数据
+class NetpbmDecoderBackend : public ImageDecoderBackend
+{
+public:
+    std::string name() const override
+    {
+        return "netpbm";
+    }
+
+    std::vector<std::string> formats() const override
+    {
+        return {"PGM", "PPM"};
+    }
+
+    bool decode(const unsigned char *data, size_t size, const std::shared_ptr<void> &dataHolder, DecodedImage &image) override
+    {
+        //仅处理二进制的P5、P6，其余交给后面的后端
+        if(size < 2 || data[0] != 'P' || (data[1] != '5' && data[1] != '6')) {
+            return false;
+        }
+        bool isGray = data[1] == '5';
+
+        size_t pos = 2;
+        int width = 0;
+        int height = 0;
+        int maxValue = 0;
+        if(!readValue(data, size, pos, width) || !readValue(data, size, pos, height) || !readValue(data, size, pos, maxValue)) {
+            return false;
+        }
+
+        //只处理8bit满量程的数据，其余情况需要重新量化
+        if(width <= 0 || height <= 0 || maxValue != 255 || pos >= size || !isspace(data[pos])) {
+            return false;
+        }
+        ++pos; //头部与像素数据之间有且只有一个空白字符
+
+        size_t step = static_cast<size_t>(width) * (isGray ? 1 : 3);
+        if((size - pos) / step < static_cast<size_t>(height)) {
+            DEEPIN_LOG("netpbm data is truncated");
+            return false;
+        }
+
+        cv::Mat wrapped(height, width, isGray ? CV_8UC1 : CV_8UC3, const_cast<unsigned char *>(data + pos), step);
+        if(dataHolder != nullptr) {
+            image.mat = wrapped;
+            image.holder = dataHolder;
+        } else {
+            image.mat = wrapped.clone();
+        }
+        image.type = isGray ? DeepinOCRPlugin::PixelType::Pixel_GRAY : DeepinOCRPlugin::PixelType::Pixel_RGB;
+        return true;
+    }
+
+private:
+    //读取头部的下一个数字，跳过空白和注释
+    static bool readValue(const unsigned char *data, size_t size, size_t &pos, int &value)
+    {
+        while(pos < size) {
+            if(data[pos] == '#') {
+                while(pos < size && data[pos] != '\n') {
+                    ++pos;
+                }
+            } else if(isspace(data[pos])) {
+                ++pos;
+            } else {
+                break;
+            }
+        }
+
+        if(pos >= size || !isdigit(data[pos])) {
+            return false;
+        }
+
+        long long result = 0;
+        while(pos < size && isdigit(data[pos])) {
+            result = result * 10 + (data[pos] - '0');
+            if(result > INT_MAX) {
+                return false;
+            }
+            ++pos;
+        }
+
+        value = static_cast<int>(result);
+        return true;
+    }
+};
+
+//BMP：未压缩的24/32位格式，自上而下存储且提供了dataHolder时直接引用数据，自下而上存储时翻转一次
+class BmpDecoderBackend : public ImageDecoderBackend
+{
+public:
+    std::string name() const override
+    {
+        return "bmp";
+    }
+
+    std::vector<std::string> formats() const override
+    {
+        return {"BMP"};
+    }
+
+    bool decode(const unsigned char *data, size_t size, const std::shared_ptr<void> &dataHolder, DecodedImage &image) override
+    {
+        //文件头14字节，BITMAPINFOHEADER至少40字节
+        if(size < 54 || data[0] != 'B' || data[1] != 'M') {
+            return false;
+        }
+
+        uint32_t dataOffset = readUInt32(data + 10);
+        uint32_t headerSize = readUInt32(data + 14);
+        int32_t width = static_cast<int32_t>(readUInt32(data + 18));
+        int32_t height = static_cast<int32_t>(readUInt32(data + 22));
+        uint16_t bitCount = readUInt16(data + 28);
+        uint32_t compression = readUInt32(data + 30);
+
+        //调色板、位域、RLE等格式交给后面的后端
+        if(headerSize < 40 || compression != 0 || (bitCount != 24 && bitCount != 32)) {
+            return false;
+        }
+        if(width <= 0 || height == 0 || height == INT32_MIN) {
+            return false;
+        }
+
+        int rows = height > 0 ? height : -height;
+        size_t step = ((static_cast<size_t>(width) * bitCount + 31) / 32) * 4;
+        if(dataOffset >= size || (size - dataOffset) / step < static_cast<size_t>(rows)) {
+            DEEPIN_LOG("bmp data is truncated");
+            return false;
+        }
+
+        cv::Mat wrapped(rows, width, bitCount == 24 ? CV_8UC3 : CV_8UC4, const_cast<unsigned char *>(data + dataOffset), step);
+        if(height > 0) {
+            cv::flip(wrapped, image.mat, 0);
+        } else if(dataHolder != nullptr) {
+            image.mat = wrapped;
+            image.holder = dataHolder;
+        } else {
+            image.mat = wrapped.clone();
+        }
+        image.type = bitCount == 24 ? DeepinOCRPlugin::PixelType::Pixel_BGR : DeepinOCRPlugin::PixelType::Pixel_BGRA;
+        return true;
+    }
+
+private:
+    static uint16_t readUInt16(const unsigned char *p)
+    {
+        return static_cast<uint16_t>(p[0] | (p[1] << 8));
+    }
+
+    static uint32_t readUInt32(const unsigned char *p)
+    {
+        return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+               (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+};
+
+#ifdef HAVE_LIBJPEG
+//JPEG：使用libjpeg(-turbo)解码，灰度图保持单通道，支持在DCT域按比例缩小，按EXIF方向转正
+class JpegDecoderBackend : public ImageDecoderBackend
+{
+public:
+    std::string name() const override
+    {
+        return "libjpeg";
+    }
+
+    std::vector<std::string> formats() const override
+    {
+        return {"JPEG"};
+    }
+
+    bool decode(const unsigned char *data, size_t size, const std::shared_ptr<void> &dataHolder, DecodedImage &image) override
+    {
+        (void)dataHolder;
+        cv::Rect rect;
+        return run(data, size, targetSide, rect, image);
+    }
+
+    bool decodeRegion(const unsigned char *data, size_t size, cv::Rect &rect, DecodedImage &image) override
+    {
+        if(rect.empty()) {
+            return false;
+        }
+        return run(data, size, 0, rect, image);
+    }
+
+    void setTargetSide(int side) override
+    {
+        targetSide = side;
+    }
+
+private:
+    struct ErrorManager {
+        jpeg_error_mgr base;
+        jmp_buf jump;
+    };
+
+    //解码整张图片（rect为空）或原分辨率下rect范围内的像素，side为按比例解码的目标尺寸，0表示不缩放
+    //局部解码时只保留rect范围内的行，读到rect的最后一行后停止
+    bool run(const unsigned char *data, size_t size, int side, cv::Rect &rect, DecodedImage &image)
+    {
+        if(size < 3 || data[0] != 0xFF || data[1] != 0xD8 || data[2] != 0xFF) {
+            return false;
+        }
+
+        jpeg_decompress_struct cinfo;
+        ErrorManager errorManager;
+        cinfo.err = jpeg_std_error(&errorManager.base);
+        errorManager.base.error_exit = errorExit;
+        errorManager.base.output_message = outputMessage;
+
+        //解码失败时（比如CMYK格式）交给后面的后端
+        cv::Mat result;
+        std::vector<unsigned char> rowBuffer;
+        if(setjmp(errorManager.jump)) {
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+
+        jpeg_create_decompress(&cinfo);
+        jpeg_mem_src(&cinfo, const_cast<unsigned char *>(data), static_cast<unsigned long>(size));
+        jpeg_save_markers(&cinfo, JPEG_APP0 + 1, 0xFFFF); //保留APP1段，用于读取EXIF中的方向
+        jpeg_read_header(&cinfo, TRUE);
+        int orientation = exifOrientation(&cinfo);
+
+        bool isGray = cinfo.jpeg_color_space == JCS_GRAYSCALE;
+#ifdef JCS_EXTENSIONS
+        cinfo.out_color_space = isGray ? JCS_GRAYSCALE : JCS_EXT_BGR;
+#else
+        cinfo.out_color_space = isGray ? JCS_GRAYSCALE : JCS_RGB;
+#endif
+
+        //选择长边仍不小于side的最小缩放比例，由libjpeg在DCT域直接缩小
+        unsigned int longSide = std::max(cinfo.image_width, cinfo.image_height);
+        if(side > 0 && longSide > static_cast<unsigned int>(side)) {
+            for(unsigned int num = 1; num <= 8; ++num) {
+                if(longSide * num / 8 >= static_cast<unsigned int>(side)) {
+                    cinfo.scale_num = num;
+                    cinfo.scale_denom = 8;
+                    break;
+                }
+            }
+        }
+
+        jpeg_start_decompress(&cinfo);
+        int width = static_cast<int>(cinfo.output_width);
+        int height = static_cast<int>(cinfo.output_height);
+        int type = isGray ? CV_8UC1 : CV_8UC3;
+
+        //EXIF方向需要调整时rect是转正后的坐标，先完整解码再裁切
+        cv::Rect rows(0, 0, width, height);
+        bool cropRows = !rect.empty() && orientation == 1;
+        if(cropRows) {
+            rect &= rows;
+            if(rect.empty()) {
+                jpeg_destroy_decompress(&cinfo);
+                return false;
+            }
+            rows = rect;
+        }
+
+        result.create(rows.height, rows.width, type);
+        rowBuffer.resize(static_cast<size_t>(width) * static_cast<size_t>(result.elemSize()));
+        while(static_cast<int>(cinfo.output_scanline) < rows.y + rows.height) {
+            int y = static_cast<int>(cinfo.output_scanline);
+            JSAMPROW row = rowBuffer.data();
+            jpeg_read_scanlines(&cinfo, &row, 1);
+            if(y >= rows.y) {
+                memcpy(result.ptr(y - rows.y), rowBuffer.data() + static_cast<size_t>(rows.x) * result.elemSize(), static_cast<size_t>(rows.width) * result.elemSize());
+            }
+        }
+        if(static_cast<int>(cinfo.output_scanline) < height) {
+            jpeg_abort_decompress(&cinfo);
+        } else {
+            jpeg_finish_decompress(&cinfo);
+        }
+
+        cv::Point2f scale(static_cast<float>(cinfo.output_width) / static_cast<float>(cinfo.image_width),
+                          static_cast<float>(cinfo.output_height) / static_cast<float>(cinfo.image_height));
+        jpeg_destroy_decompress(&cinfo);
+
+        //与cv::imread一致，按EXIF方向将图像转正，转置时宽高的比例互换
+        applyOrientation(result, orientation);
+        image.scale = orientation >= 5 ? cv::Point2f(scale.y, scale.x) : scale;
+        if(!rect.empty() && !cropRows) {
+            rect &= cv::Rect(0, 0, result.cols, result.rows);
+            if(rect.empty()) {
+                return false;
+            }
+            result = result(rect).clone();
+        }
+
+        image.mat = result;
+#ifdef JCS_EXTENSIONS
+        image.type = isGray ? DeepinOCRPlugin::PixelType::Pixel_GRAY : DeepinOCRPlugin::PixelType::Pixel_BGR;
+#else
+        image.type = isGray ? DeepinOCRPlugin::PixelType::Pixel_GRAY : DeepinOCRPlugin::PixelType::Pixel_RGB;
+#endif
+        return true;
+    }
+
+    static void errorExit(j_common_ptr cinfo)
+    {
+        longjmp(reinterpret_cast<ErrorManager *>(cinfo->err)->jump, 1);
+    }
+
+    static void outputMessage(j_common_ptr cinfo)
+    {
+        (void)cinfo;
+    }
+
+    //读取EXIF中的方向标签，没有或无法解析时返回1（不需要调整）
+    static int exifOrientation(j_decompress_ptr cinfo)
+    {
+        for(jpeg_saved_marker_ptr marker = cinfo->marker_list; marker != nullptr; marker = marker->next) {
+            const unsigned char *data = marker->data;
+            size_t size = marker->data_length;
+            if(marker->marker != JPEG_APP0 + 1 || size < 14 || memcmp(data, "Exif\0\0", 6) != 0) {
+                continue;
+            }
+
+            //TIFF头：字节序、固定值42、第一个IFD的偏移
+            const unsigned char *tiff = data + 6;
+            size_t tiffSize = size - 6;
+            bool bigEndian = tiff[0] == 'M' && tiff[1] == 'M';
+            if(!bigEndian && !(tiff[0] == 'I' && tiff[1] == 'I')) {
+                return 1;
+            }
+            auto read16 = [tiff, bigEndian](size_t offset) {
+                return bigEndian ? static_cast<uint16_t>((tiff[offset] << 8) | tiff[offset + 1])
+                                 : static_cast<uint16_t>(tiff[offset] | (tiff[offset + 1] << 8));
+            };
+            auto read32 = [read16, bigEndian](size_t offset) {
+                uint32_t first = read16(offset);
+                uint32_t second = read16(offset + 2);
+                return bigEndian ? (first << 16) | second : (second << 16) | first;
+            };
+            if(read16(2) != 42) {
+                return 1;
+            }
+
+            size_t ifdOffset = read32(4);
+            if(ifdOffset + 2 > tiffSize) {
+                return 1;
+            }
+            size_t count = read16(ifdOffset);
+            for(size_t i = 0; i != count; ++i) {
+                size_t entry = ifdOffset + 2 + i * 12;
+                if(entry + 12 > tiffSize) {
+                    break;
+                }
+                if(read16(entry) == 0x0112) {
+                    int orientation = read16(entry + 8);
+                    return orientation >= 1 && orientation <= 8 ? orientation : 1;
+                }
+            }
+            return 1;
+        }
+        return 1;
+    }
+
+    //按EXIF方向调整图像，变换方式与OpenCV相同
+    static void applyOrientation(cv::Mat &mat, int orientation)
+    {
+        switch(orientation)
+        {
+        default:
+            break;
+        case 2:
+            cv::flip(mat, mat, 1);
+            break;
+        case 3:
+            cv::flip(mat, mat, -1);
+            break;
+        case 4:
+            cv::flip(mat, mat, 0);
+            break;
+        case 5:
+            cv::transpose(mat, mat);
+            break;
+        case 6:
+            cv::transpose(mat, mat);
+            cv::flip(mat, mat, 1);
+            break;
+        case 7:
+            cv::transpose(mat, mat);
+            cv::flip(mat, mat, -1);
+            break;
+        case 8:
+            cv::transpose(mat, mat);
+            cv::flip(mat, mat, 0);
+            break;
+        }
+    }
+
+    int targetSide = 0;
+};
+#endif
+
+#ifdef HAVE_LIBSPNG
+//PNG：使用libspng解码，灰度图保持单通道，带透明通道的保持四通道
+class PngDecoderBackend : public ImageDecoderBackend
+{
+public:
+    std::string name() const override
+    {
+        return "libspng";
+    }
+
+    std::vector<std::string> formats() const override
+    {
+        return {"PNG"};
+    }
+
+    bool decode(const unsigned char *data, size_t size, const std::shared_ptr<void> &dataHolder, DecodedImage &image) override
+    {
+        (void)dataHolder;
+        static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        if(size < sizeof(signature) || !std::equal(signature, signature + sizeof(signature), data)) {
+            return false;
+        }
+
+        std::unique_ptr<spng_ctx, decltype(&spng_ctx_free)> ctx(spng_ctx_new(0), spng_ctx_free);
+        if(ctx == nullptr || spng_set_png_buffer(ctx.get(), data, size) != 0) {
+            return false;
+        }
+
+        spng_ihdr ihdr;
+        if(spng_get_ihdr(ctx.get(), &ihdr) != 0) {
+            return false;
+        }
+
+        int format = SPNG_FMT_RGB8;
+        int matType = CV_8UC3;
+        DeepinOCRPlugin::PixelType pixelType = DeepinOCRPlugin::PixelType::Pixel_RGB;
+        if(ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE && ihdr.bit_depth <= 8) {
+            format = SPNG_FMT_G8;
+            matType = CV_8UC1;
+            pixelType = DeepinOCRPlugin::PixelType::Pixel_GRAY;
+        } else if(ihdr.color_type == SPNG_COLOR_TYPE_GRAYSCALE_ALPHA || ihdr.color_type == SPNG_COLOR_TYPE_TRUECOLOR_ALPHA) {
+            format = SPNG_FMT_RGBA8;
+            matType = CV_8UC4;
+            pixelType = DeepinOCRPlugin::PixelType::Pixel_RGBA;
+        }
+
+        size_t imageSize = 0;
+        if(spng_decoded_image_size(ctx.get(), format, &imageSize) != 0) {
+            return false;
+        }
+
+        cv::Mat result(static_cast<int>(ihdr.height), static_cast<int>(ihdr.width), matType);
+        if(imageSize != result.total() * result.elemSize() ||
+           spng_decode_image(ctx.get(), result.data, imageSize, format, 0) != 0) {
+            return false;
+        }
+
+        image.mat = result;
+        image.type = pixelType;
+        return true;
+    }
+};
+#endif
+
+//兜底后端：OpenCV自带的解码器
+class OpenCVDecoderBackend : public ImageDecoderBackend
+{
+public:
+    std::string name() const override
+    {
+        return "opencv";
+    }
+
+    std::vector<std::string> formats() const override
+    {
+        return {"BMP", "JPEG", "PNG", "PBM", "PGM", "PPM"};
+    }
+
+    bool decode(const unsigned char *data, size_t size, const std::shared_ptr<void> &dataHolder, DecodedImage &image) override
+    {
+        (void)dataHolder;
+        if(size > static_cast<size_t>(INT_MAX)) {
+            return false;
+        }
+
+        //imdecode只读取数据，这里仅构造矩阵头
+        cv::Mat encoded(1, static_cast<int>(size), CV_8UC1, const_cast<unsigned char *>(data));
+        image.mat = cv::imdecode(encoded, cv::IMREAD_COLOR);
+        image.type = DeepinOCRPlugin::PixelType::Pixel_BGR;
+        return image.mat.data != nullptr;
+    }
+};
+
+ImageDecoder::ImageDecoder()
+{
+    backends.emplace_back(new NetpbmDecoderBackend);
+    backends.emplace_back(new BmpDecoderBackend);
+#ifdef HAVE_LIBJPEG
+    backends.emplace_back(new JpegDecoderBackend);
+#endif
+#ifdef HAVE_LIBSPNG
+    backends.emplace_back(new PngDecoderBackend);
+#endif
+    backends.emplace_back(new OpenCVDecoderBackend);
+}
+
+std::vector<std::string> ImageDecoder::supportFormats() const
+{
+    std::vector<std::string> result;
+    for(auto &backend : backends) {
+        for(auto &format : backend->formats()) {
+            if(std::find(result.begin(), result.end(), format) == result.end()) {
+                result.push_back(format);
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<std::string> ImageDecoder::backendNames() const
+{
+    std::vector<std::string> result;
+    for(auto &backend : backends) {
+        result.push_back(backend->name());
+    }
+    return result;
+}
+
+bool ImageDecoder::decodeFile(const std::string &filePath, DecodedImage &image)
+{
+    int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        DEEPIN_LOG("open %s failed", filePath.c_str());
+        return false;
+    }
+
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode) || fileStat.st_size <= 0) {
+        close(fd);
+        DEEPIN_LOG("%s is not a valid image file", filePath.c_str());
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(fileStat.st_size);
+    void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED) {
+        DEEPIN_LOG("mmap %s failed", filePath.c_str());
+        return false;
+    }
+
+    //映射在最后一个引用者释放时解除
+    std::shared_ptr<void> mapping(mapped, [size](void *ptr) {
+        munmap(ptr, size);
+    });
+    return decode(static_cast<const unsigned char *>(mapped), size, mapping, image);
+}
+
+bool ImageDecoder::decodeData(const unsigned char *data, size_t size, DecodedImage &image)
+{
+    if(!decode(data, size, nullptr, image)) {
+        return false;
+    }
+
+    //按比例解码时保留一份编码数据，原分辨率的局部解码需要使用
+    if(image.sourceData != nullptr) {
+        auto copied = std::make_shared<std::vector<unsigned char>>(data, data + size);
+        image.sourceData = copied->data();
+        image.source = copied;
+    }
+    return true;
+}
+
+bool ImageDecoder::decodeRegion(const DecodedImage &image, cv::Rect &rect, DecodedImage &region)
+{
+    if(image.sourceData == nullptr) {
+        return false;
+    }
+
+    for(auto &backend : backends) {
+        region = DecodedImage();
+        cv::Rect clipped = rect;
+        if(backend->decodeRegion(image.sourceData, image.sourceSize, clipped, region)) {
+            rect = clipped;
+            return true;
+        }
+    }
+
+    region = DecodedImage();
+    return false;
+}
+
+void ImageDecoder::setTargetSide(int side)
+{
+    targetSide = std::max(side, 0);
+    for(auto &backend : backends) {
+        backend->setTargetSide(targetSide);
+    }
+}
+
+int ImageDecoder::getTargetSide() const
+{
+    return targetSide;
+}
+
+bool ImageDecoder::decode(const unsigned char *data, size_t size, const std::shared_ptr<void> &dataHolder, DecodedImage &image)
+{
+    for(auto &backend : backends) {
+        image = DecodedImage();
+        if(backend->decode(data, size, dataHolder, image)) {
+            //按比例解码时记录编码数据的位置，调用方负责保证其有效
+            if(image.scale != cv::Point2f(1.0f, 1.0f)) {
+                image.source = dataHolder;
+                image.sourceData = data;
+                image.sourceSize = size;
+            }
+            return true;
+        }
+    }
+
+    image = DecodedImage();
+    return false;
+}
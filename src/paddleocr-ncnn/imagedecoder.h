@@ -0,0 +1,110 @@
+/*
+* Copyright (C) 2020 ~ 2022 Deepin Technology Co., Ltd.
+*
+* Author: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* Maintainer: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <deepinocrplugindef.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+//解码结果
+struct DecodedImage {
+    cv::Mat mat;                      //图像数据
+    DeepinOCRPlugin::PixelType type = DeepinOCRPlugin::PixelType::Pixel_Unknown; //图像数据格式
+    std::shared_ptr<void> holder;     //mat引用外部内存（比如文件映射）时的数据持有者
+    cv::Point2f scale = cv::Point2f(1.0f, 1.0f); //解码尺寸相对原图的比例，宽高分别计算，按比例解码时小于1
+
+    //按比例解码时保留的编码数据，需要原分辨率的局部图像时用decodeRegion解码
+    std::shared_ptr<void> source;
+    const unsigned char *sourceData = nullptr;
+    size_t sourceSize = 0;
+};
+
+//解码后端，每个后端负责一种或几种格式
+class ImageDecoderBackend
+{
+public:
+    virtual ~ImageDecoderBackend() = default;
+
+    //后端名称
+    virtual std::string name() const = 0;
+
+    //支持的图片格式，与getImageFileSupportFormats的输出一致
+    virtual std::vector<std::string> formats() const = 0;
+
+    //执行解码，格式不符或无法处理时返回false，由下一个后端继续尝试
+    //dataHolder不为空时表示data的生命周期可以由它延长，后端可以直接引用data而不进行拷贝
+    virtual bool decode(const unsigned char *data, size_t size, const std::shared_ptr<void> &dataHolder, DecodedImage &image) = 0;
+
+    //设置按比例解码的目标尺寸，不支持缩放解码的后端忽略即可
+    virtual void setTargetSide(int side)
+    {
+        (void)side;
+    }
+
+    //按原分辨率解码rect范围内的像素，rect为原图坐标，返回时截断到图像范围内
+    //只有支持按比例解码的后端需要实现，格式不符时返回false
+    virtual bool decodeRegion(const unsigned char *data, size_t size, cv::Rect &rect, DecodedImage &image)
+    {
+        (void)data;
+        (void)size;
+        (void)rect;
+        (void)image;
+        return false;
+    }
+};
+
+//图片解码器，按优先级依次尝试构建时可用的各个后端
+class ImageDecoder
+{
+public:
+    ImageDecoder();
+
+    //全部可用后端支持的图片格式
+    std::vector<std::string> supportFormats() const;
+
+    //全部可用后端的名称
+    std::vector<std::string> backendNames() const;
+
+    //解码文件，文件通过mmap映射到内存，未压缩的格式可以直接引用映射的内存
+    bool decodeFile(const std::string &filePath, DecodedImage &image);
+
+    //解码内存中的图片数据，返回的图像不引用data
+    bool decodeData(const unsigned char *data, size_t size, DecodedImage &image);
+
+    //按原分辨率解码按比例解码过的图片中rect范围内的像素，rect为原图坐标，返回时截断到图像范围内
+    //image为decodeFile或decodeData的结果，没有保留编码数据时返回false
+    bool decodeRegion(const DecodedImage &image, cv::Rect &rect, DecodedImage &region);
+
+    //设置按比例解码的目标尺寸，支持缩放解码的后端会将长边缩小到不小于该值的最小尺寸，0表示按原尺寸解码
+    void setTargetSide(int side);
+    int getTargetSide() const;
+
+private:
+    bool decode(const unsigned char *data, size_t size, const std::shared_ptr<void> &dataHolder, DecodedImage &image);
+
+    std::vector<std::unique_ptr<ImageDecoderBackend>> backends;
+    int targetSide = 0;
+};
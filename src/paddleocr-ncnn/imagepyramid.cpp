@@ -0,0 +1,112 @@
+/*
+* Copyright (C) 2020 ~ 2022 Deepin Technology Co., Ltd.
+*
+* Author: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* Maintainer: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "imagepyramid.h"
+
+//金字塔最小层的短边长度，再小就没有意义了
+static constexpr int MinLevelSide = 32;
+
+void ImagePyramid::reset(const cv::Mat &image, DeepinOCRPlugin::PixelType type)
+{
+    std::lock_guard<std::mutex> locker(mutex);
+
+    levels.clear();
+    sizes.clear();
+    pixelType = type;
+    if(image.empty()) {
+        return;
+    }
+
+    levels.push_back(image);
+    sizes.emplace_back(image.cols, isYUV420(type) ? image.rows * 2 / 3 : image.rows);
+
+    //YUV420的色度平面无法直接按通道缩放，只保留原图
+    if(isYUV420(type)) {
+        return;
+    }
+
+    cv::Size current = sizes.back();
+    while(std::min(current.width, current.height) / 2 >= MinLevelSide) {
+        current = cv::Size(current.width / 2, current.height / 2);
+        sizes.push_back(current);
+    }
+    levels.resize(sizes.size());
+}
+
+void ImagePyramid::clear()
+{
+    reset(cv::Mat(), DeepinOCRPlugin::PixelType::Pixel_Unknown);
+}
+
+bool ImagePyramid::empty() const
+{
+    return sizes.empty();
+}
+
+DeepinOCRPlugin::PixelType ImagePyramid::type() const
+{
+    return pixelType;
+}
+
+cv::Size ImagePyramid::size() const
+{
+    return sizes.empty() ? cv::Size(0, 0) : sizes[0];
+}
+
+int ImagePyramid::levelCount() const
+{
+    return static_cast<int>(sizes.size());
+}
+
+cv::Size ImagePyramid::levelSize(int index) const
+{
+    return sizes[static_cast<size_t>(index)];
+}
+
+cv::Mat ImagePyramid::level(int index)
+{
+    std::lock_guard<std::mutex> locker(mutex);
+
+    //从已有的最近一层逐层向下构建，每层只由上一层缩小一半得到
+    for(size_t i = 1; i <= static_cast<size_t>(index); ++i) {
+        if(levels[i].empty()) {
+            cv::resize(levels[i - 1], levels[i], sizes[i], 0, 0, cv::INTER_AREA);
+        }
+    }
+
+    return levels[static_cast<size_t>(index)];
+}
+
+int ImagePyramid::levelForScale(float scale) const
+{
+    if(sizes.empty() || scale >= 1.0f) {
+        return 0;
+    }
+
+    int result = 0;
+    for(size_t i = 1; i < sizes.size(); ++i) {
+        if(sizes[i].width < sizes[0].width * scale || sizes[i].height < sizes[0].height * scale) {
+            break;
+        }
+        result = static_cast<int>(i);
+    }
+    return result;
+}
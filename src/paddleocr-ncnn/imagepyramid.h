@@ -0,0 +1,75 @@
+/*
+* Copyright (C) 2020 ~ 2022 Deepin Technology Co., Ltd.
+*
+* Author: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* Maintainer: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <deepinocrplugindef.h>
+
+#include <opencv2/opencv.hpp>
+
+#include <mutex>
+#include <vector>
+
+//是否为YUV420格式，这类格式的数据行数为图像高度的1.5倍
+static inline bool isYUV420(DeepinOCRPlugin::PixelType type)
+{
+    return type == DeepinOCRPlugin::PixelType::Pixel_NV12 ||
+           type == DeepinOCRPlugin::PixelType::Pixel_NV21 ||
+           type == DeepinOCRPlugin::PixelType::Pixel_I420;
+}
+
+//图像金字塔，第0层为原图，之后每层长宽减半，各层在第一次使用时才构建
+//检测和识别裁切都从不小于所需尺寸的最小一层取数据，使缩放的计算量只与输出尺寸相关
+class ImagePyramid
+{
+public:
+    //设置原图，清空已构建的层，原图数据只读不写
+    void reset(const cv::Mat &image, DeepinOCRPlugin::PixelType type);
+
+    //清空全部数据
+    void clear();
+
+    bool empty() const;
+
+    //图像数据格式，各层相同
+    DeepinOCRPlugin::PixelType type() const;
+
+    //原图尺寸，YUV格式为图像本身的尺寸而不是数据的行列数
+    cv::Size size() const;
+
+    //层数
+    int levelCount() const;
+
+    //第index层的尺寸
+    cv::Size levelSize(int index) const;
+
+    //获取第index层的数据，线程安全
+    cv::Mat level(int index);
+
+    //选择相对原图缩小到scale后仍不小于所需尺寸的最小一层，scale不小于1时返回第0层
+    int levelForScale(float scale) const;
+
+private:
+    std::mutex mutex;
+    std::vector<cv::Mat> levels;
+    std::vector<cv::Size> sizes;
+    DeepinOCRPlugin::PixelType pixelType = DeepinOCRPlugin::PixelType::Pixel_Unknown;
+};
@@ -0,0 +1,110 @@
+/*
+* Copyright (C) 2020 ~ 2022 Deepin Technology Co., Ltd.
+*
+* Author: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* Maintainer: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ocrmodels.h"
+
+#include <ncnn/net.h>
+
+#include <fstream>
+
+OCRModels::~OCRModels()
+{
+    delete detNet;
+    delete recNet;
+}
+
+std::string NetOptions::key() const
+{
+    return std::string(lightmode ? "1" : "0") + (winograd ? "1" : "0") + (sgemm ? "1" : "0") + (packing ? "1" : "0");
+}
+
+std::shared_ptr<OCRModels> loadOCRModels(const std::string &modelDir, const std::string &language,
+                                         const std::vector<int> &gpus, const NetOptions &options)
+{
+    //文件名后缀
+    const std::string paramSuffix = ".param.bin";
+    const std::string binSuffix = ".bin";
+    const std::string dictSuffix = ".txt";
+
+    //ncnn基础设置，线程数由各次推理的Extractor单独设置
+    ncnn::Option option;
+    option.lightmode = options.lightmode;
+    option.use_winograd_convolution = options.winograd;
+    option.use_sgemm_convolution = options.sgemm;
+    option.use_packing_layout = options.packing;
+    option.use_int8_inference = false;
+    option.num_threads = 1;
+
+    auto loaded = std::make_shared<OCRModels>();
+
+    //初始化检测网络
+    std::string detModel = modelDir + "det";
+    loaded->detNet = new ncnn::Net;
+    loaded->detNet->opt = option;
+    loaded->detNet->load_param_bin((detModel + paramSuffix).c_str());
+    loaded->detNet->load_model((detModel + binSuffix).c_str());
+
+    //初始化识别网络
+    std::string recModel = modelDir + "rec_" + language;
+    loaded->recNet = new ncnn::Net;
+    loaded->recNet->opt = option;
+
+    //由于检测网络的速度足够快，因此GPU设备仅给识别网络使用以节省GPU初始化时间
+    if (!gpus.empty()) {
+        loaded->recNet->set_vulkan_device(gpus[0]);
+        loaded->recNet->opt.use_vulkan_compute = true;
+    }
+
+    loaded->recNet->load_param_bin((recModel + paramSuffix).c_str());
+    loaded->recNet->load_model((recModel + binSuffix).c_str());
+
+    //初始化字典
+    std::string dictFile = modelDir + language + dictSuffix;
+    std::fstream fs;
+    fs.open(dictFile, std::ios::in);
+    std::string line;
+    loaded->keys.emplace_back("#");
+    while (getline(fs, line)) {
+        loaded->keys.emplace_back(line);
+    }
+    loaded->keys.emplace_back(" ");
+
+    return loaded;
+}
+
+std::shared_ptr<const OCRModels> SharedModels::acquire(const std::string &modelDir, const std::string &language,
+                                                       const std::vector<int> &gpus, const NetOptions &options)
+{
+    std::string key = modelDir + "|" + language + "|" + options.key() + "|";
+    for(auto gpu : gpus) {
+        key += std::to_string(gpu) + ",";
+    }
+
+    //加载期间持有锁，同时初始化的其他会话等待加载完成后直接复用
+    std::lock_guard<std::mutex> locker(mutex);
+    if(models != nullptr && modelsKey == key) {
+        return models;
+    }
+
+    models = loadOCRModels(modelDir, language, gpus, options);
+    modelsKey = key;
+    return models;
+}
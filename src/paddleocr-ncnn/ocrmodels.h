@@ -0,0 +1,72 @@
+/*
+* Copyright (C) 2020 ~ 2022 Deepin Technology Co., Ltd.
+*
+* Author: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* Maintainer: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ncnn {
+    class Net;
+}
+
+//加载网络时使用的ncnn选项，可由自动调优选择
+struct NetOptions {
+    bool lightmode = true;
+    bool winograd = true; //Winograd卷积
+    bool sgemm = true;    //SGEMM卷积
+    bool packing = true;  //packing内存布局
+
+    std::string key() const; //选项的文本形式，用于区分不同选项加载的模型
+};
+
+//一套加载完成的检测网络、识别网络和字典，加载后只读，可以在多个线程中同时创建Extractor推理
+struct OCRModels {
+    OCRModels() = default;
+    OCRModels(const OCRModels &) = delete;
+    OCRModels &operator=(const OCRModels &) = delete;
+    ~OCRModels();
+
+    ncnn::Net *detNet = nullptr;
+    ncnn::Net *recNet = nullptr;
+    std::vector<std::string> keys;
+};
+
+//加载一套模型，modelDir：模型目录，language：识别语种，gpus：识别网络可用的GPU设备
+std::shared_ptr<OCRModels> loadOCRModels(const std::string &modelDir, const std::string &language,
+                                         const std::vector<int> &gpus, const NetOptions &options);
+
+//同一插件创建的各个会话之间共享的模型
+//设置变化时加载新的模型，旧模型由仍在使用它的会话持有，全部释放后销毁
+class SharedModels
+{
+public:
+    //获取与设置对应的模型，与当前模型的设置一致时直接返回，线程安全，参数同loadOCRModels
+    std::shared_ptr<const OCRModels> acquire(const std::string &modelDir, const std::string &language,
+                                             const std::vector<int> &gpus, const NetOptions &options);
+
+private:
+    std::mutex mutex;
+    std::shared_ptr<const OCRModels> models;
+    std::string modelsKey; //models对应的设置
+};
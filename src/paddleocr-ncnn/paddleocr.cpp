@@ -22,18 +22,25 @@
 #include "paddleocr.h"
 
 #include <toolkits.h>
+#include <threadbudget.h>
 
 #include <ncnn/net.h>
 #include <ncnn/layer.h>
+#include <ncnn/cpu.h>
 
 #include <algorithm>
-#include <fstream>
+#include <chrono>
+#include <numeric>
 #include <set>
-#include <thread>
 #include <cstdlib>
 #include <cstring>
+#include <cerrno>
+#include <climits>
+#include <cmath>
 #include <filesystem>
 
+#include <sched.h>
+
 void *loadPlugin()
 {
     return new PaddleOCRApp();
@@ -51,6 +58,7 @@ int pluginVersion(void)
 }
 
 PaddleOCRApp::PaddleOCRApp()
+    : sharedModels(std::make_shared<SharedModels>())
 {
     //获取资源路径位置
     std::string fullPath;
@@ -93,6 +101,12 @@ PaddleOCRApp::PaddleOCRApp()
     }
 }
 
+PaddleOCRApp::PaddleOCRApp(std::shared_ptr<SharedModels> models, const std::string &modelDir)
+    : currentPath(modelDir)
+    , sharedModels(std::move(models))
+{
+}
+
 PaddleOCRApp::~PaddleOCRApp()
 {
     resetNet();
@@ -100,13 +114,12 @@ PaddleOCRApp::~PaddleOCRApp()
 
 void PaddleOCRApp::resetNet()
 {
-    delete detNet;
-    delete recNet;
+    //模型由各个会话共享，这里只释放当前会话的引用
+    models.reset();
 
-    detNet = nullptr;
-    recNet = nullptr;
-
-    keys.clear();
+    //识别网络变化后上一帧的结果和识别缓存都不能再复用
+    lastFrame.tileHashes.clear();
+    recCache.clear();
 
     needReset = false;
 }
@@ -118,7 +131,15 @@ void PaddleOCRApp::initNet()
         DEEPIN_LOG("model load failed");
     }
 
-    if (detNet != nullptr && recNet != nullptr && !keys.empty()) {
+    //开启自动调优后第一次初始化时读取本机的调优结果，没有时执行调优
+    if(autotuneEnabled && autotunePending) {
+        autotunePending = false;
+        autotune();
+    }
+
+    updateThreads();
+
+    if (models != nullptr) {
         return;
     }
 
@@ -136,80 +157,479 @@ void PaddleOCRApp::initNet()
     }
     std::vector<int> gpuCanUse(gpuCanUseSet.begin(), gpuCanUseSet.end());
 
-    //多线程设置
-    unsigned int maxThreads = std::thread::hardware_concurrency();
-    if(maxThreads <= 0) {
-        maxThreads = 1;
+    NetOptions options = autotuneEnabled && tuneResult.valid ? tuneResult.options : NetOptions();
+    models = sharedModels->acquire(currentPath, languageUsed, gpuCanUse, options);
+}
+
+void PaddleOCRApp::autotune()
+{
+    //调优结果在进程内共享，同时初始化的会话等待同一次调优完成
+    //调优只在CPU上进行，线程数上限为当前可用的CPU数，调优期间加载的模型不与其他会话共享
+    tuneResult = AutoTuner::acquire([this](const NetOptions &options) {
+        return std::shared_ptr<const OCRModels>(loadOCRModels(currentPath, languageUsed, std::vector<int>(), options));
+    }, detectSide(), getAvailableCpuCount());
+
+    //网络选项可能变化，按新的选项重新获取模型
+    models.reset();
+}
+
+//检测网络是单次推理，线程数超过该值后收益很小，自动选择时不再增加
+static constexpr unsigned int AutoDetectThreadsMax = 8;
+
+void PaddleOCRApp::updateThreads()
+{
+    //可用的CPU数综合了亲和性掩码和cgroup配额，宿主机的核心数可能远多于容器的配额
+    availableCpus = getAvailableCpuCount();
+
+    //绑定到部分CPU时，线程数不超过这些CPU的个数
+    affinityCpus = profileCpus();
+    if(!affinityCpus.empty()) {
+        availableCpus = std::min(availableCpus, static_cast<unsigned int>(affinityCpus.size()));
+    }
+
+    //有调优结果时按图像的尺寸分类使用测得的线程数，调用方设置的线程数作为上限
+    if(autotuneEnabled && tuneResult.valid) {
+        int sizeClass = AutoTuner::sizeClass(imagePyramid.size());
+        unsigned int limit = maxThreadsUsed == 0 ? availableCpus : std::min(maxThreadsUsed, availableCpus);
+        detThreadsUsed = std::min(tuneResult.detThreads[sizeClass], limit);
+        recThreadsUsed = std::min(tuneResult.recThreads[sizeClass], limit);
+        return;
+    }
+
+    unsigned int threads = maxThreadsUsed;
+    if(threads == 0) {
+        threads = availableCpus;
+
+        //考虑负载时扣除其他进程占用的CPU，平均负载中包含本插件上一次推理的线程，需要先减去
+        if(loadAwareThreads) {
+            double load = getLoadAverage();
+            if(load > 0) {
+                double others = std::max(0.0, load - recThreadsUsed);
+                threads = static_cast<unsigned int>(std::max(1.0, availableCpus - std::floor(others)));
+            }
+        }
+        detThreadsUsed = std::min(threads, AutoDetectThreadsMax);
+
+        //节能模式下识别也只使用一半的CPU
+        if(cpuProfile == CpuProfile::Efficiency) {
+            threads = std::max(1u, threads / 2);
+            detThreadsUsed = std::min(detThreadsUsed, threads);
+        }
+    } else {
+        threads = std::min(threads, availableCpus);
+        detThreadsUsed = threads;
+    }
+    recThreadsUsed = threads;
+}
+
+std::vector<int> PaddleOCRApp::profileCpus() const
+{
+    //显式指定的CPU优先，否则按配置文件选择大核或小核，均衡模式不绑定
+    std::vector<int> candidates = cpuMask;
+    if(candidates.empty()) {
+        if(cpuProfile == CpuProfile::Balanced) {
+            return candidates;
+        }
+
+        //ncnn的省电设置：1为小核，2为大核，不区分大小核的设备上均为全部CPU
+        const ncnn::CpuSet &profileMask = ncnn::get_cpu_thread_affinity_mask(cpuProfile == CpuProfile::Latency ? 2 : 1);
+        for(int i = 0; i < ncnn::get_cpu_count(); ++i) {
+            if(profileMask.is_enabled(i)) {
+                candidates.push_back(i);
+            }
+        }
+    }
+
+    //只保留进程允许使用的CPU
+    cpu_set_t processMask;
+    CPU_ZERO(&processMask);
+    if(sched_getaffinity(0, sizeof(processMask), &processMask) != 0) {
+        return candidates;
+    }
+
+    std::vector<int> result;
+    for(auto cpu : candidates) {
+        if(cpu < CPU_SETSIZE && CPU_ISSET(cpu, &processMask)) {
+            result.push_back(cpu);
+        }
+    }
+    return result;
+}
+
+int PaddleOCRApp::detectSide() const
+{
+    //节能模式下降低检测分辨率，但不低于自适应检测的低分辨率
+    if(cpuProfile == CpuProfile::Efficiency) {
+        return std::max(detectCoarseSide, detectMaxSide * 3 / 4);
+    }
+    return detectMaxSide;
+}
+
+//推理期间将OpenMP线程绑定到指定的CPU，析构时恢复调用线程和OpenMP线程池原来的亲和性以及OpenMP线程数
+//线程池属于调用线程，不恢复的话取消绑定后线程池会一直留在之前的CPU上，也会影响宿主程序在该线程上的OpenMP计算
+class ThreadPinning
+{
+public:
+    explicit ThreadPinning(const std::vector<int> &cpus)
+    {
+        if(cpus.empty()) {
+            return;
+        }
+
+        CPU_ZERO(&callerMask);
+        if(sched_getaffinity(0, sizeof(callerMask), &callerMask) != 0) {
+            return;
+        }
+
+        ncnn::CpuSet mask;
+        for(auto cpu : cpus) {
+            mask.enable(cpu);
+        }
+        ompThreads = ncnn::get_omp_num_threads();
+        pinned = ncnn::set_cpu_thread_affinity(mask) == 0;
+    }
+
+    ~ThreadPinning()
+    {
+        if(pinned) {
+            ncnn::CpuSet callerCpus;
+            for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if(CPU_ISSET(cpu, &callerMask)) {
+                    callerCpus.enable(cpu);
+                }
+            }
+            ncnn::set_cpu_thread_affinity(callerCpus);
+            sched_setaffinity(0, sizeof(callerMask), &callerMask);
+            ncnn::set_omp_num_threads(ompThreads);
+        }
+    }
+
+    ThreadPinning(const ThreadPinning &) = delete;
+    ThreadPinning &operator=(const ThreadPinning &) = delete;
+
+private:
+    bool pinned = false;
+    cpu_set_t callerMask;
+    int ompThreads = 1;
+};
+
+//自适应检测时，低分辨率下行高小于该值的文本需要用高分辨率重新检测
+static constexpr int SmallTextHeight = 12;
+
+//文本框的外接矩形
+static cv::Rect boxBoundingRect(const std::vector<std::vector<int>> &box)
+{
+    int left = std::min({box[0][0], box[1][0], box[2][0], box[3][0]});
+    int top = std::min({box[0][1], box[1][1], box[2][1], box[3][1]});
+    int right = std::max({box[0][0], box[1][0], box[2][0], box[3][0]});
+    int bottom = std::max({box[0][1], box[1][1], box[2][1], box[3][1]});
+    return cv::Rect(left, top, right - left + 1, bottom - top + 1);
+}
+
+//合并相交的矩形区域，直到所有区域互不相交
+static void mergeRegions(std::vector<cv::Rect> &regions)
+{
+    bool merged = true;
+    while(merged) {
+        merged = false;
+        for(size_t i = 0; i < regions.size() && !merged; ++i) {
+            for(size_t j = i + 1; j < regions.size(); ++j) {
+                if((regions[i] & regions[j]).area() > 0) {
+                    regions[i] |= regions[j];
+                    regions.erase(regions.begin() + static_cast<long>(j));
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+//TextBox转换为检测结果的文本框格式
+static std::vector<std::vector<int>> textBoxToBox(const DeepinOCRPlugin::TextBox &textBox)
+{
+    std::vector<std::vector<int>> box;
+    for(auto &point : textBox.points) {
+        box.push_back({static_cast<int>(point.first), static_cast<int>(point.second)});
+    }
+    return box;
+}
+
+//检测网络输入使用的ncnn像素类型，格式转换在缩放的同时完成
+//输出的通道顺序与BGR数据按PIXEL_RGB输入时保持一致；YUV格式仅使用Y平面作为灰度图输入
+static int detPixelType(DeepinOCRPlugin::PixelType type)
+{
+    switch(type)
+    {
+    case DeepinOCRPlugin::PixelType::Pixel_RGB:
+        return ncnn::Mat::PIXEL_RGB2BGR;
+    case DeepinOCRPlugin::PixelType::Pixel_GRAY:
+    case DeepinOCRPlugin::PixelType::Pixel_NV12:
+    case DeepinOCRPlugin::PixelType::Pixel_NV21:
+    case DeepinOCRPlugin::PixelType::Pixel_I420:
+        return ncnn::Mat::PIXEL_GRAY2RGB;
+    case DeepinOCRPlugin::PixelType::Pixel_RGBA:
+        return ncnn::Mat::PIXEL_RGBA2BGR;
+    case DeepinOCRPlugin::PixelType::Pixel_BGRA:
+        return ncnn::Mat::PIXEL_BGRA2BGR;
+    default:
+        return ncnn::Mat::PIXEL_RGB;
+    }
+}
+
+//将YUV420图像中rect范围内的像素转换为BGR，rect的坐标和尺寸需要为偶数
+static cv::Mat cropYUV420ToBGR(const cv::Mat &src, DeepinOCRPlugin::PixelType type, const cv::Rect &rect)
+{
+    int h = src.rows * 2 / 3;
+
+    //先把局部的Y平面和色度平面拼成一张小的YUV420图
+    cv::Mat part(rect.height * 3 / 2, rect.width, CV_8UC1);
+    cv::Mat yPart = part.rowRange(0, rect.height);
+    src(rect).copyTo(yPart);
+
+    if(type == DeepinOCRPlugin::PixelType::Pixel_I420) {
+        size_t chromaStep = src.step / 2;
+        unsigned char *uPlane = src.data + static_cast<size_t>(h) * src.step;
+        unsigned char *vPlane = uPlane + static_cast<size_t>(h / 2) * chromaStep;
+        cv::Rect chromaRect(rect.x / 2, rect.y / 2, rect.width / 2, rect.height / 2);
+
+        unsigned char *dst = part.ptr(rect.height);
+        cv::Mat uPart(chromaRect.height, chromaRect.width, CV_8UC1, dst);
+        cv::Mat vPart(chromaRect.height, chromaRect.width, CV_8UC1, dst + chromaRect.area());
+        cv::Mat(h / 2, src.cols / 2, CV_8UC1, uPlane, chromaStep)(chromaRect).copyTo(uPart);
+        cv::Mat(h / 2, src.cols / 2, CV_8UC1, vPlane, chromaStep)(chromaRect).copyTo(vPart);
+    } else {
+        cv::Mat uvPart = part.rowRange(rect.height, part.rows);
+        src(cv::Rect(rect.x, h + rect.y / 2, rect.width, rect.height / 2)).copyTo(uvPart);
+    }
+
+    int cvtCode = cv::COLOR_YUV2BGR_NV12;
+    if(type == DeepinOCRPlugin::PixelType::Pixel_NV21) {
+        cvtCode = cv::COLOR_YUV2BGR_NV21;
+    } else if(type == DeepinOCRPlugin::PixelType::Pixel_I420) {
+        cvtCode = cv::COLOR_YUV2BGR_I420;
+    }
+
+    cv::Mat result;
+    cv::cvtColor(part, result, cvtCode);
+    return result;
+}
+
+std::vector<std::vector<std::vector<int>>> PaddleOCRApp::detect(float thresh, float boxThresh, float unclipRatio)
+{
+    cv::Rect fullRect(cv::Point(0, 0), imagePyramid.size());
+    if(regionsOfInterest.empty()) {
+        return detectArea(fullRect, thresh, boxThresh, unclipRatio);
+    }
+
+    //只检测感兴趣区域，区域在原图上的坐标需要换算到当前图像上，相交的区域合并后再检测，避免重复的文本框
+    std::vector<cv::Rect> regions;
+    for(auto &roi : regionsOfInterest) {
+        cv::Rect region(static_cast<int>(roi.x * imageScale.x), static_cast<int>(roi.y * imageScale.y),
+                        static_cast<int>(std::ceil(roi.width * imageScale.x)), static_cast<int>(std::ceil(roi.height * imageScale.y)));
+        region &= fullRect;
+        if(!region.empty()) {
+            regions.push_back(region);
+        }
+    }
+    mergeRegions(regions);
+
+    std::vector<std::vector<std::vector<int>>> boxes;
+    for(auto &region : regions) {
+        auto regionBoxes = detectArea(region, thresh, boxThresh, unclipRatio);
+        if(stopRequested()) {
+            return std::vector<std::vector<std::vector<int>>>();
+        }
+        boxes.insert(boxes.end(), regionBoxes.begin(), regionBoxes.end());
+    }
+
+    return boxes;
+}
+
+std::vector<std::vector<std::vector<int>>> PaddleOCRApp::detectArea(const cv::Rect &area, float thresh, float boxThresh, float unclipRatio)
+{
+    if(!adaptiveDetect) {
+        return detectRegion(area, detectSide(), thresh, boxThresh, unclipRatio);
+    }
+
+    //自适应模式：先用低分辨率检测一遍，估计文本的位置和行高
+    auto coarseBoxes = detectRegion(area, detectCoarseSide, thresh, boxThresh, unclipRatio);
+    if(stopRequested()) {
+        return std::vector<std::vector<std::vector<int>>>();
+    }
+
+    //什么都没检测到时，可能是文字太小，退回到完整的高分辨率检测以保证召回率
+    if(coarseBoxes.empty()) {
+        return detectRegion(area, detectSide(), thresh, boxThresh, unclipRatio);
+    }
+
+    //低分辨率下行高过小的文本框，检测结果不可靠，其周围的区域需要用高分辨率重新检测
+    float coarseScale = std::min(1.0f, static_cast<float>(detectCoarseSide) / std::max(area.width, area.height));
+    std::vector<cv::Rect> fineRegions;
+    for(auto &box : coarseBoxes) {
+        cv::Rect boxRect = boxBoundingRect(box);
+        if(boxRect.height * coarseScale >= SmallTextHeight) {
+            continue;
+        }
+
+        //向外扩展两倍行高，使相邻的小字行能被包含进来
+        int margin = std::max(boxRect.height * 2, 16);
+        cv::Rect expanded(boxRect.x - margin, boxRect.y - margin, boxRect.width + margin * 2, boxRect.height + margin * 2);
+        fineRegions.push_back(expanded & area);
+    }
+
+    if(fineRegions.empty()) {
+        return coarseBoxes;
+    }
+
+    //合并相交的区域
+    mergeRegions(fineRegions);
+
+    //需要重新检测的区域过大时，直接整个区域重新检测更划算
+    long long fineArea = 0;
+    for(auto &region : fineRegions) {
+        fineArea += region.area();
     }
-    if (maxThreadsUsed > maxThreads) {
-        maxThreadsUsed = maxThreads;
+    if(fineArea * 2 > static_cast<long long>(area.area())) {
+        return detectRegion(area, detectSide(), thresh, boxThresh, unclipRatio);
     }
 
-    //文件名后缀
-    const std::string paramSuffix = ".param.bin";
-    const std::string binSuffix = ".bin";
-    const std::string dictSuffix = ".txt";
+    //去掉落在重新检测区域内的低分辨率结果，再加入高分辨率结果
+    auto insideFineRegions = [&fineRegions](const std::vector<std::vector<int>> &box) {
+        cv::Rect boxRect = boxBoundingRect(box);
+        cv::Point center(boxRect.x + boxRect.width / 2, boxRect.y + boxRect.height / 2);
+        return std::any_of(fineRegions.begin(), fineRegions.end(), [&center](const cv::Rect &region) {
+            return region.contains(center);
+        });
+    };
+    coarseBoxes.erase(std::remove_if(coarseBoxes.begin(), coarseBoxes.end(), insideFineRegions), coarseBoxes.end());
+
+    //小字区域使用与整个区域高分辨率检测相同的缩放比例
+    float fineScale = std::min(1.0f, static_cast<float>(detectSide()) / std::max(area.width, area.height));
+    for(auto &region : fineRegions) {
+        int maxSide = static_cast<int>(std::ceil(std::max(region.width, region.height) * fineScale));
+        auto fineBoxes = detectRegion(region, maxSide, thresh, boxThresh, unclipRatio);
+        if(stopRequested()) {
+            return std::vector<std::vector<std::vector<int>>>();
+        }
+        coarseBoxes.insert(coarseBoxes.end(), fineBoxes.begin(), fineBoxes.end());
+    }
 
-    //ncnn基础设置
-    ncnn::Option option;
-    option.lightmode = true;
-    option.use_int8_inference = false;
-    option.num_threads = 1;
+    return coarseBoxes;
+}
 
-    //初始化检测网络
-    if (detNet == nullptr) {
-        std::string detModel = currentPath + "det";
+//有时间预算时，检测网络输入的面积超过DetTileSide*DetTileSide的1.5倍就分块检测，相邻分块重叠DetTileOverlap
+static constexpr int DetTileSide = 640;
+static constexpr int DetTileOverlap = 32;
 
-        detNet = new ncnn::Net;
-        detNet->opt = option;
-        detNet->opt.num_threads = static_cast<int>(maxThreadsUsed);
-        detNet->load_param_bin((detModel + paramSuffix).c_str());
-        detNet->load_model((detModel + binSuffix).c_str());
+//合并分块检测的结果：跨越分块边界的文本行在相邻分块中各检测出一段，重叠区域中的文本行会被检测两次
+//来自不同分块、相交且处于同一行（或大部分重叠）的文本框合并为二者的外接矩形
+static std::vector<std::vector<std::vector<int>>> mergeTileBoxes(const std::vector<std::pair<int, std::vector<std::vector<int>>>> &tileBoxes)
+{
+    struct TileBox
+    {
+        int tile; //来源分块，合并后为-1
+        cv::Rect rect;
+        std::vector<std::vector<int>> box;
+    };
+
+    std::vector<TileBox> boxes;
+    for(auto &tileBox : tileBoxes) {
+        boxes.push_back({tileBox.first, boxBoundingRect(tileBox.second), tileBox.second});
     }
 
-    //初始化识别网络
-    if (recNet == nullptr) {
-        std::string recModel = currentPath + "rec_" + languageUsed;
+    auto shouldMerge = [](const TileBox &left, const TileBox &right) {
+        if(left.tile == right.tile && left.tile >= 0) {
+            return false;
+        }
+
+        cv::Rect intersection = left.rect & right.rect;
+        if(intersection.empty()) {
+            return false;
+        }
 
-        recNet = new ncnn::Net;
-        recNet->opt = option;
+        bool sameLine = intersection.height * 2 >= std::min(left.rect.height, right.rect.height);
+        bool duplicate = intersection.area() * 2 >= std::min(left.rect.area(), right.rect.area());
+        return sameLine || duplicate;
+    };
+
+    bool merged = true;
+    while(merged) {
+        merged = false;
+        for(size_t i = 0; i < boxes.size() && !merged; ++i) {
+            for(size_t j = i + 1; j < boxes.size(); ++j) {
+                if(!shouldMerge(boxes[i], boxes[j])) {
+                    continue;
+                }
 
-        //由于检测网络的速度足够快，因此GPU设备仅给识别网络使用以节省GPU初始化时间
-        if (!gpuCanUse.empty()) {
-            recNet->set_vulkan_device(gpuCanUse[0]);
-            recNet->opt.use_vulkan_compute = true;
+                cv::Rect rect = boxes[i].rect | boxes[j].rect;
+                int right = rect.x + rect.width - 1;
+                int bottom = rect.y + rect.height - 1;
+                boxes[i] = {-1, rect, {{rect.x, rect.y}, {right, rect.y}, {right, bottom}, {rect.x, bottom}}};
+                boxes.erase(boxes.begin() + static_cast<std::ptrdiff_t>(j));
+                merged = true;
+                break;
+            }
         }
+    }
+
+    std::vector<std::vector<std::vector<int>>> result;
+    for(auto &box : boxes) {
+        result.push_back(std::move(box.box));
+    }
+    return result;
+}
+
+std::vector<std::vector<std::vector<int>>> PaddleOCRApp::detectRegion(const cv::Rect &region, int maxSide, float thresh, float boxThresh, float unclipRatio)
+{
+    float ratio = std::min(1.0f, static_cast<float>(maxSide) / std::max(region.width, region.height));
+    float inputArea = region.width * ratio * region.height * ratio;
+    if(!hasDeadline || inputArea <= DetTileSide * DetTileSide * 1.5f) {
+        return detectRegionOnce(region, maxSide, thresh, boxThresh, unclipRatio);
+    }
 
-        recNet->load_param_bin((recModel + paramSuffix).c_str());
-        recNet->load_model((recModel + binSuffix).c_str());
+    //按之前测得的耗时估计，剩余时间足够一次完成时不分块，分块处的文本行会被切断
+    float msPerPixel = detMsPerPixel;
+    if(msPerPixel > 0 && inputArea * msPerPixel < remainingMs()) {
+        return detectRegionOnce(region, maxSide, thresh, boxThresh, unclipRatio);
     }
 
-    //初始化字典
-    if (keys.empty()) {
-        std::string dictFile = currentPath + languageUsed + dictSuffix;
-        std::fstream fs;
-        fs.open(dictFile, std::ios::in);
-        std::string line;
-        keys.emplace_back("#");
-        while (getline(fs, line)) {
-            keys.emplace_back(line);
+    //分块检测使单次推理的耗时有上限，超时或终止时能及时停止
+    resultDegraded = true;
+    int tileSide = static_cast<int>(DetTileSide / ratio);
+    int overlap = static_cast<int>(DetTileOverlap / ratio);
+    std::vector<std::pair<int, std::vector<std::vector<int>>>> tileBoxes;
+    int tileIndex = 0;
+    for(int y = region.y; y < region.y + region.height; y += tileSide) {
+        for(int x = region.x; x < region.x + region.width; x += tileSide, ++tileIndex) {
+            cv::Rect tile = cv::Rect(x - overlap, y - overlap, tileSide + overlap * 2, tileSide + overlap * 2) & region;
+            int tileMaxSide = static_cast<int>(std::ceil(std::max(tile.width, tile.height) * ratio));
+            auto boxes = detectRegionOnce(tile, tileMaxSide, thresh, boxThresh, unclipRatio);
+            if(stopRequested()) {
+                return std::vector<std::vector<std::vector<int>>>();
+            }
+
+            for(auto &box : boxes) {
+                tileBoxes.emplace_back(tileIndex, std::move(box));
+            }
         }
-        keys.emplace_back(" ");
     }
+
+    return mergeTileBoxes(tileBoxes);
 }
 
-std::vector<std::vector<std::vector<int>>> PaddleOCRApp::detect(const cv::Mat &src, float thresh, float boxThresh, float unclipRatio)
+std::vector<std::vector<std::vector<int>>> PaddleOCRApp::detectRegionOnce(const cv::Rect &region, int maxSide, float thresh, float boxThresh, float unclipRatio)
 {
-    int w = src.cols;
-    int h = src.rows;
+    int w = region.width;
+    int h = region.height;
 
     //1.缩减尺寸
     float ratio = 1.f;
-    if (std::max(w, h) > 960) {
+    if (std::max(w, h) > maxSide) {
         if (h > w) {
-            ratio = 960.0f / h;
+            ratio = static_cast<float>(maxSide) / h;
         } else {
-            ratio = 960.0f / w;
+            ratio = static_cast<float>(maxSide) / w;
         }
     }
 
@@ -232,26 +652,45 @@ std::vector<std::vector<std::vector<int>>> PaddleOCRApp::detect(const cv::Mat &s
     resizeH = int(round(float(resizeH) / 32) * 32);
     resizeW = int(round(float(resizeW) / 32) * 32);
 
-    //执行resize，记录变换比例
-    cv::Mat resize_img;
-    cv::resize(src, resize_img, cv::Size(resizeW, resizeH));
+    //记录变换比例
     float ratio_h = float(resizeH) / float(h);
     float ratio_w = float(resizeW) / float(w);
 
-    //执行推理
-    ncnn::Mat in_pad = ncnn::Mat::from_pixels(resize_img.data, ncnn::Mat::PIXEL_RGB, resizeW, resizeH);
+    //从金字塔中选择不小于目标尺寸的最小一层，缩放和格式转换一并完成，只转换缩小后的像素
+    int levelIndex = imagePyramid.levelForScale(std::max(ratio_w, ratio_h));
+    cv::Mat level = imagePyramid.level(levelIndex);
+    cv::Size levelSize = imagePyramid.levelSize(levelIndex);
+    cv::Size srcSize = imagePyramid.size();
+    float levelScaleX = static_cast<float>(levelSize.width) / static_cast<float>(srcSize.width);
+    float levelScaleY = static_cast<float>(levelSize.height) / static_cast<float>(srcSize.height);
+    int levelX = static_cast<int>(region.x * levelScaleX);
+    int levelY = static_cast<int>(region.y * levelScaleY);
+    int levelW = std::max(1, std::min(static_cast<int>(std::ceil(region.width * levelScaleX)), levelSize.width - levelX));
+    int levelH = std::max(1, std::min(static_cast<int>(std::ceil(region.height * levelScaleY)), levelSize.height - levelY));
+    const unsigned char *levelData = level.data + static_cast<size_t>(levelY) * level.step + static_cast<size_t>(levelX) * level.elemSize();
+    ncnn::Mat in_pad = ncnn::Mat::from_pixels_resize(levelData, detPixelType(imagePyramid.type()), levelW, levelH,
+                                                     static_cast<int>(level.step), resizeW, resizeH);
 
     const float meanValues[3] = { 0.485f * 255, 0.456f * 255, 0.406f * 255 };
     const float normValues[3] = { 1.0f / 0.229f / 255.0f, 1.0f / 0.224f / 255.0f, 1.0f / 0.225f / 255.0f };
 
     in_pad.substract_mean_normalize(meanValues, normValues);
-    ncnn::Extractor extractor = detNet->create_extractor();
-
-    extractor.input(0, in_pad);
     ncnn::Mat out;
-    extractor.extract(detNet->output_indexes()[0], out);
+    {
+        //推理线程从进程的线程预算中租用，推理完成后立即归还
+        DeepinOCRPlugin::ThreadLease lease(detThreadsUsed);
+        detThreadsGranted = lease.count();
+
+        auto start = std::chrono::steady_clock::now();
+        ncnn::Extractor extractor = models->detNet->create_extractor();
+        extractor.set_num_threads(static_cast<int>(lease.count()));
+        extractor.input(0, in_pad);
+        extractor.extract(models->detNet->output_indexes()[0], out);
+        std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        detMsPerPixel = elapsed.count() / static_cast<float>(resizeW * resizeH);
+    }
 
-    if(needBreak) {
+    if(stopRequested()) {
         return std::vector<std::vector<std::vector<int>>>();
     }
 
@@ -271,7 +710,7 @@ std::vector<std::vector<std::vector<int>>> PaddleOCRApp::detect(const cv::Mat &s
         }
     }
 
-    if(needBreak) {
+    if(stopRequested()) {
         return std::vector<std::vector<std::vector<int>>>();
     }
 
@@ -285,17 +724,27 @@ std::vector<std::vector<std::vector<int>>> PaddleOCRApp::detect(const cv::Mat &s
     cv::Mat dila_ele = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(2, 2));
     cv::dilate(bit_map, dilation_map, dila_ele);
 
-    if(needBreak) {
+    if(stopRequested()) {
         return std::vector<std::vector<std::vector<int>>>();
     }
 
     auto result = postProcessor.BoxesFromBitmap(pred_map, dilation_map, boxThresh, unclipRatio, false);
 
-    if(needBreak) {
+    if(stopRequested()) {
         return std::vector<std::vector<std::vector<int>>>();
     }
 
-    result = postProcessor.FilterTagDetRes(result, ratio_h, ratio_w, src);
+    result = postProcessor.FilterTagDetRes(result, ratio_h, ratio_w, w, h);
+
+    //区域坐标换算回整图坐标
+    if(region.x != 0 || region.y != 0) {
+        for(auto &box : result) {
+            for(auto &point : box) {
+                point[0] += region.x;
+                point[1] += region.y;
+            }
+        }
+    }
 
     return result;
 }
@@ -313,7 +762,7 @@ std::pair<std::string, std::vector<int>> PaddleOCRApp::ctcDecode(const std::vect
         ++currentSize;
         //CTC特性：连续相同即判定为同一个字，在判定为下一字的时候，之前的积累就会变成上一个字的长度
         if (maxIndex > 0 && (i == 0 || maxIndex != lastIndex)) {
-            text.append(keys[static_cast<size_t>(maxIndex)]);
+            text.append(models->keys[static_cast<size_t>(maxIndex)]);
 
             if (status == 0) {
                 status = 1;
@@ -347,24 +796,286 @@ std::vector<DeepinOCRPlugin::TextBox> PaddleOCRApp::lengthToBox(const std::vecto
     return result;
 }
 
-void PaddleOCRApp::rec(const std::vector<cv::Mat> &detectImg)
+//文本框外接矩形或边长小于MinBoxSide时无法透视变换裁切
+static constexpr int MinBoxSide = 2;
+
+static bool isDegenerateBox(const std::vector<std::vector<int>> &box)
+{
+    auto xRange = std::minmax({box[0][0], box[1][0], box[2][0], box[3][0]});
+    auto yRange = std::minmax({box[0][1], box[1][1], box[2][1], box[3][1]});
+    if(xRange.second - xRange.first < MinBoxSide || yRange.second - yRange.first < MinBoxSide) {
+        return true;
+    }
+
+    float lineWidth = sqrtf(powf(box[0][0] - box[1][0], 2) + powf(box[0][1] - box[1][1], 2));
+    float lineHeight = sqrtf(powf(box[0][0] - box[3][0], 2) + powf(box[0][1] - box[3][1], 2));
+    return lineWidth < MinBoxSide || lineHeight < MinBoxSide;
+}
+
+//识别网络的输入高度
+static constexpr float RecInputHeight = 32.0f;
+
+//文本框中文本的高度，取两条边中较短的一条
+static float boxTextHeight(const std::vector<std::vector<int>> &box)
+{
+    float lineWidth = sqrtf(powf(box[0][0] - box[1][0], 2) + powf(box[0][1] - box[1][1], 2));
+    float lineHeight = sqrtf(powf(box[0][0] - box[3][0], 2) + powf(box[0][1] - box[3][1], 2));
+    return std::min(lineWidth, lineHeight);
+}
+
+void PaddleOCRApp::prepareFullResolution(const std::vector<std::vector<std::vector<int>>> &boxes)
+{
+    fullRegion.release();
+    if(imageSource.sourceData == nullptr) {
+        return;
+    }
+
+    //按比例解码的图像中高度不足识别网络输入的文本行需要原分辨率的像素，只解码这些文本行的外接范围
+    cv::Rect area;
+    for(size_t i = 0; i != boxes.size(); ++i) {
+        if(lineChanged[i] && !isDegenerateBox(boxes[i]) && boxTextHeight(boxes[i]) < RecInputHeight) {
+            area = area.empty() ? boxBoundingRect(boxes[i]) : (area | boxBoundingRect(boxes[i]));
+        }
+    }
+    if(area.empty()) {
+        return;
+    }
+
+    //换算到原图坐标，四周多留一个像素
+    int left = static_cast<int>(std::floor(area.x / imageScale.x)) - 1;
+    int top = static_cast<int>(std::floor(area.y / imageScale.y)) - 1;
+    int right = static_cast<int>(std::ceil((area.x + area.width) / imageScale.x)) + 1;
+    int bottom = static_cast<int>(std::ceil((area.y + area.height) / imageScale.y)) + 1;
+    cv::Rect rect(std::max(left, 0), std::max(top, 0), right - std::max(left, 0), bottom - std::max(top, 0));
+
+    DecodedImage region;
+    if(!imageDecoder.decodeRegion(imageSource, rect, region)) {
+        return;
+    }
+
+    switch(region.type)
+    {
+    case DeepinOCRPlugin::PixelType::Pixel_GRAY:
+        cv::cvtColor(region.mat, fullRegion, cv::COLOR_GRAY2BGR);
+        break;
+    case DeepinOCRPlugin::PixelType::Pixel_RGB:
+        cv::cvtColor(region.mat, fullRegion, cv::COLOR_RGB2BGR);
+        break;
+    case DeepinOCRPlugin::PixelType::Pixel_BGR:
+        fullRegion = region.mat;
+        break;
+    default:
+        return;
+    }
+    fullRegionRect = rect;
+}
+
+cv::Mat PaddleOCRApp::cropLine(const std::vector<std::vector<int>> &box, float &scale)
+{
+    float textHeight = boxTextHeight(box);
+
+    //高度不足的文本行从原分辨率的局部图像中裁切，坐标换算到局部图像中
+    if(!fullRegion.empty() && textHeight < RecInputHeight) {
+        auto fullBox = box;
+        for(auto &point : fullBox) {
+            point[0] = std::clamp(static_cast<int>(std::lround(point[0] / imageScale.x)) - fullRegionRect.x, 0, fullRegion.cols - 1);
+            point[1] = std::clamp(static_cast<int>(std::lround(point[1] / imageScale.y)) - fullRegionRect.y, 0, fullRegion.rows - 1);
+        }
+        if(!isDegenerateBox(fullBox)) {
+            scale = 1.0f / imageScale.x;
+            return utilityTool.GetRotateCropImage(fullRegion, fullBox);
+        }
+    }
+
+    //识别网络的输入高度固定为32，从金字塔中选择文本行高度仍不小于32的最小一层进行裁切
+    int levelIndex = textHeight > 0 ? imagePyramid.levelForScale(RecInputHeight / textHeight) : 0;
+
+    cv::Mat level = imagePyramid.level(levelIndex);
+    cv::Size levelSize = imagePyramid.levelSize(levelIndex);
+    cv::Size srcSize = imagePyramid.size();
+    float scaleX = static_cast<float>(levelSize.width) / static_cast<float>(srcSize.width);
+    float scaleY = static_cast<float>(levelSize.height) / static_cast<float>(srcSize.height);
+    scale = scaleX;
+
+    //文本框坐标换算到所选的层中
+    auto levelBox = box;
+    if(levelIndex != 0) {
+        for(auto &point : levelBox) {
+            point[0] = std::min(static_cast<int>(point[0] * scaleX), levelSize.width - 1);
+            point[1] = std::min(static_cast<int>(point[1] * scaleY), levelSize.height - 1);
+        }
+    }
+
+    auto type = imagePyramid.type();
+    if(type == DeepinOCRPlugin::PixelType::Pixel_BGR) {
+        return utilityTool.GetRotateCropImage(level, levelBox);
+    }
+
+    //其余格式只转换文本框外接矩形范围内的像素
+    int left = std::min({levelBox[0][0], levelBox[1][0], levelBox[2][0], levelBox[3][0]});
+    int top = std::min({levelBox[0][1], levelBox[1][1], levelBox[2][1], levelBox[3][1]});
+    int right = std::min(std::max({levelBox[0][0], levelBox[1][0], levelBox[2][0], levelBox[3][0]}) + 1, levelSize.width);
+    int bottom = std::min(std::max({levelBox[0][1], levelBox[1][1], levelBox[2][1], levelBox[3][1]}) + 1, levelSize.height);
+    if(isYUV420(type)) { //色度平面是2x2采样的，需要对齐到偶数
+        left &= ~1;
+        top &= ~1;
+        right = std::min((right + 1) & ~1, levelSize.width);
+        bottom = std::min((bottom + 1) & ~1, levelSize.height);
+    }
+    cv::Rect rect(left, top, right - left, bottom - top);
+
+    cv::Mat region;
+    switch(type)
+    {
+    case DeepinOCRPlugin::PixelType::Pixel_GRAY:
+        cv::cvtColor(level(rect), region, cv::COLOR_GRAY2BGR);
+        break;
+    case DeepinOCRPlugin::PixelType::Pixel_RGB:
+        cv::cvtColor(level(rect), region, cv::COLOR_RGB2BGR);
+        break;
+    case DeepinOCRPlugin::PixelType::Pixel_RGBA:
+        cv::cvtColor(level(rect), region, cv::COLOR_RGBA2BGR);
+        break;
+    case DeepinOCRPlugin::PixelType::Pixel_BGRA:
+        cv::cvtColor(level(rect), region, cv::COLOR_BGRA2BGR);
+        break;
+    default:
+        region = cropYUV420ToBGR(level, type, rect);
+        break;
+    }
+
+    //文本框坐标平移到局部区域中
+    for(auto &point : levelBox) {
+        point[0] -= left;
+        point[1] -= top;
+    }
+
+    return utilityTool.GetRotateCropImage(region, levelBox);
+}
+
+std::vector<float> PaddleOCRApp::recInfer(const cv::Mat &stdMat, size_t index, int &steps, int &classes)
+{
+    ncnn::Mat input = ncnn::Mat::from_pixels(stdMat.data, ncnn::Mat::PIXEL_RGB, stdMat.cols, stdMat.rows);
+    const float mean_vals[3] = { 127.5, 127.5, 127.5 };
+    const float norm_vals[3] = { 1.0f / 127.5f, 1.0f / 127.5f, 1.0f / 127.5f };
+    input.substract_mean_normalize(mean_vals, norm_vals);
+
+    auto outIndexes = models->recNet->output_indexes();
+    ncnn::Extractor extractor = models->recNet->create_extractor();
+
+    if(models->recNet->opt.use_vulkan_compute) {
+        //当可用线程 > 1 同时不是第 1 个线程时，使用CPU进行计算
+        //即确保显卡只处理单次的推理
+#if defined(_loongarch) || defined(__loongarch__) || defined(__loongarch64)
+        extractor.set_vulkan_compute(false);
+#else
+        if (recThreadsUsed > 1 && index % recThreadsUsed != 1) {
+            extractor.set_vulkan_compute(false);
+        }
+#endif
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    extractor.input(0, input);
+    ncnn::Mat out;
+    extractor.extract(outIndexes[outIndexes.size() - 1], out);
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    recMsPerColumn = elapsed.count() / static_cast<float>(stdMat.cols);
+
+    float *floatArray = static_cast<float *>(out.data);
+    steps = out.h;
+    classes = out.w;
+    return std::vector<float>(floatArray, floatArray + out.h * out.w);
+}
+
+std::pair<std::string, std::vector<int>> PaddleOCRApp::recLine(const cv::Mat &stdMat, size_t index)
+{
+    //读取数据，执行CTC算法解析数据
+    int steps = 0;
+    int classes = 0;
+    std::vector<float> recNetOutputData = recInfer(stdMat, index, steps, classes);
+
+    return ctcDecode(recNetOutputData, steps, classes);
+}
+
+//有时间预算且剩余时间不够时，识别网络输入宽度超过RecChunkWidth的文本行分段识别
+static constexpr int RecChunkWidth = 320;
+
+//分段推理时每段向两侧多取的宽度，使分段处的字符能在某一段中完整出现
+static constexpr int RecChunkOverlap = 32;
+
+std::pair<std::string, std::vector<int>> PaddleOCRApp::recLineChunked(const cv::Mat &stdMat, size_t index)
+{
+    if(stdMat.cols <= RecChunkWidth) {
+        return recLine(stdMat, index);
+    }
+
+    //分段识别使单次推理的耗时有上限，每段带上两侧的重叠部分推理，只保留核心部分对应的时间步
+    //各段的时间步拼接后统一执行CTC解码，结果的格式与整行识别一致
+    std::vector<float> outputs;
+    int steps = 0;
+    int classes = 0;
+    for(int x = 0; x < stdMat.cols; x += RecChunkWidth) {
+        if(stopRequested()) {
+            break;
+        }
+
+        int coreEnd = std::min(x + RecChunkWidth, stdMat.cols);
+        int begin = std::max(0, x - RecChunkOverlap);
+        int end = std::min(stdMat.cols, coreEnd + RecChunkOverlap);
+        int chunkSteps = 0;
+        int chunkClasses = 0;
+        auto chunkOutputs = recInfer(stdMat.colRange(begin, end).clone(), index, chunkSteps, chunkClasses);
+        if(chunkSteps <= 0) {
+            continue;
+        }
+
+        float stepWidth = static_cast<float>(end - begin) / static_cast<float>(chunkSteps);
+        int first = std::clamp(static_cast<int>(std::lround((x - begin) / stepWidth)), 0, chunkSteps);
+        int last = std::clamp(static_cast<int>(std::lround((coreEnd - begin) / stepWidth)), first, chunkSteps);
+        outputs.insert(outputs.end(), chunkOutputs.begin() + first * chunkClasses, chunkOutputs.begin() + last * chunkClasses);
+        steps += last - first;
+        classes = chunkClasses;
+    }
+
+    return ctcDecode(outputs, steps, classes);
+}
+
+void PaddleOCRApp::rec(const std::vector<cv::Mat> &detectImg, const std::vector<float> &cropScales)
 {
     size_t size = detectImg.size();
-    allResult.clear();
-    std::vector<std::string> allResultVec(detectImg.size());
     boxesResult.resize(detectImg.size());
-    charBoxes.resize(detectImg.size());
+    charLengths.resize(detectImg.size());
+    charRatios.resize(detectImg.size());
+
+    //线程数不超过需要识别的文本行数，从进程的线程预算中租用
+    size_t pending = std::count_if(detectImg.begin(), detectImg.end(), [](const cv::Mat &image) {
+        return !image.empty();
+    });
+    if(pending == 0) {
+        return;
+    }
+    DeepinOCRPlugin::ThreadLease lease(static_cast<unsigned int>(std::min<size_t>(recThreadsUsed, pending)));
+    recThreadsGranted = lease.count();
 
     //带LSTM的模型在外面开多线程加速效果会比在里面开多线程加速好
-    #pragma omp parallel for num_threads(maxThreadsUsed)
+    //动态调度使文本行按阅读顺序被依次取走识别，逐行回调时前面的文本行能更早输出
+    #pragma omp parallel for num_threads(lease.count()) schedule(dynamic)
     for (size_t i = 0; i < size; ++i) {
-        if(needBreak) {
+        //空图像为已有识别结果的文本行，不需要再识别
+        if(stopRequested() || detectImg[i].empty()) {
             continue;
         }
 
         //输入图片固定高度32
         float ratio = static_cast<float>(detectImg[i].cols) / static_cast<float>(detectImg[i].rows);
         int imgW = static_cast<int>(32 * ratio);
+
+        //缩放后宽度不足1像素的图像无法识别，结果留空
+        if(imgW < 1) {
+            lineFinished(i);
+            continue;
+        }
         int resize_w;
         if (ceilf(32 * ratio) > imgW)
             resize_w = imgW;
@@ -375,67 +1086,46 @@ void PaddleOCRApp::rec(const std::vector<cv::Mat> &detectImg)
         cv::resize(detectImg[i], stdMat, cv::Size(resize_w, 32), 0, 0, cv::INTER_LINEAR);
         cv::copyMakeBorder(stdMat, stdMat, 0, 0, 0, int(imgW - stdMat.cols), cv::BORDER_CONSTANT, {127, 127, 127});
 
-        float realRatio = static_cast<float>(stdMat.cols) / detectImg[i].cols;
+        //裁切自金字塔中缩小过的层时，比例需要换算回原图
+        float realRatio = static_cast<float>(stdMat.cols) / detectImg[i].cols * cropScales[i];
 
-        if(needBreak) {
+        if(stopRequested()) {
             continue;
         }
 
-        ncnn::Mat input = ncnn::Mat::from_pixels(stdMat.data, ncnn::Mat::PIXEL_RGB, stdMat.cols, stdMat.rows);
-        const float mean_vals[3] = { 127.5, 127.5, 127.5 };
-        const float norm_vals[3] = { 1.0f / 127.5f, 1.0f / 127.5f, 1.0f / 127.5f };
-        input.substract_mean_normalize(mean_vals, norm_vals);
-
-        auto outIndexes = recNet->output_indexes();
-        ncnn::Extractor extractor = recNet->create_extractor();
-
-        if(recNet->opt.use_vulkan_compute) {
-            //当可用线程 > 1 同时不是第 1 个线程时，使用CPU进行计算
-            //即确保显卡只处理单次的推理
-#if defined(_loongarch) || defined(__loongarch__) || defined(__loongarch64)
-            extractor.set_vulkan_compute(false);
-#else
-            if (maxThreadsUsed > 1 && i % maxThreadsUsed != 1) {
-                extractor.set_vulkan_compute(false);
+        //相同的输入图像直接使用缓存的识别结果
+        bool useCache = recCache.capacity() > 0;
+        uint64_t cacheKey = useCache ? RecCache::hashInput(stdMat) : 0;
+        std::pair<std::string, std::vector<int>> ctcResult;
+        if(!useCache || !recCache.find(cacheKey, ctcResult.first, ctcResult.second)) {
+            //剩余时间不够一次识别整行时才分段识别，分段处的字符可能受影响，结果不写入缓存
+            float msPerColumn = recMsPerColumn;
+            bool chunked = hasDeadline && stdMat.cols > RecChunkWidth
+                           && (msPerColumn <= 0 || stdMat.cols * msPerColumn >= remainingMs());
+            if(chunked) {
+                resultDegraded = true;
+                ctcResult = recLineChunked(stdMat, i);
+            } else {
+                ctcResult = recLine(stdMat, i);
             }
-#endif
-        }
 
-        extractor.input(0, input);
-        ncnn::Mat out;
-        extractor.extract(outIndexes[outIndexes.size() - 1], out);
+            if(stopRequested()) {
+                continue;
+            }
 
-        if(needBreak) {
-            continue;
+            if(useCache && !chunked) {
+                recCache.insert(cacheKey, ctcResult.first, ctcResult.second);
+            }
         }
 
-        //读取数据，执行CTC算法解析数据
-        float *floatArray = static_cast<float *>(out.data);
-        std::vector<float> recNetOutputData(floatArray, floatArray + out.h * out.w);
-
-        auto ctcResult = ctcDecode(recNetOutputData, out.h, out.w);
-
-        //总体识别结果收集
-        allResultVec[i] = ctcResult.first;
-
         //文本块识别结果收集
         boxesResult[i] = ctcResult.first;
 
-        //精确字符位置结果收集
-        auto box = textBoxes[i];
-        auto baseSize = ctcResult.second;
-        auto currentCharBox = lengthToBox(baseSize, textBoxes[i].points[0], box.points[2].second - box.points[0].second, realRatio);
-        charBoxes[i] = currentCharBox;
+        //字符长度结果收集，字符位置在getCharBoxes时才计算
+        charLengths[i] = std::move(ctcResult.second);
+        charRatios[i] = realRatio;
 
-        if(needBreak) {
-            continue;
-        }
-    }
-
-    //总体识别结果存入
-    for(const auto &eachResult : allResultVec) {
-        allResult += eachResult;
-        allResult += "\n";
+        lineFinished(i);
     }
 }
 
@@ -453,20 +1143,103 @@ std::vector<DeepinOCRPlugin::HardwareID> PaddleOCRApp::getHardwareSupportList()
 
 bool PaddleOCRApp::setUseMaxThreadsCount(unsigned int n)
 {
-    needReset = true;
+    //线程数在每次推理时单独设置，不需要重新加载模型
     maxThreadsUsed = n;
     return true;
 }
 
 std::vector<std::string> PaddleOCRApp::getImageFileSupportFormats()
 {
-    return {"BMP", "JPEG", "PNG", "PBM", "PGM", "PPM"};
+    return imageDecoder.supportFormats();
 }
 
 bool PaddleOCRApp::setImageFile(const std::string &filePath)
 {
-    imageCache = cv::imread(filePath);
-    return imageCache.data != nullptr;
+    uint64_t fileKey = resultCache->enabled() ? ResultCache::fileIdentity(filePath) : 0;
+
+    //命中磁盘缓存时先不解码，analyze时直接输出缓存的结果，需要图像数据时再解码
+    if(fileKey != 0) {
+        setImage(cv::Mat(), DeepinOCRPlugin::PixelType::Pixel_Unknown, nullptr, false);
+        imageFileKey = fileKey;
+        uint64_t key = resultKey();
+        if(resultCache->load(key, cachedResult)) {
+            cachedResultKey = key;
+            deferredFilePath = filePath;
+            return true;
+        }
+    }
+
+    DecodedImage image;
+    imageDecoder.decodeFile(filePath, image);
+    setDecodedImage(image);
+    imageFileKey = fileKey;
+    return !imagePyramid.empty();
+}
+
+bool PaddleOCRApp::ensureImage()
+{
+    if(imagePyramid.empty() && !deferredFilePath.empty()) {
+        uint64_t fileKey = imageFileKey;
+        DecodedImage image;
+        imageDecoder.decodeFile(deferredFilePath, image);
+        setDecodedImage(image);
+        imageFileKey = fileKey;
+    }
+
+    return !imagePyramid.empty();
+}
+
+uint64_t PaddleOCRApp::resultKey()
+{
+    //模型文件的标识只在语种变化时重新计算
+    if(modelKeyLanguage != languageUsed) {
+        uint64_t detKey = ResultCache::fileIdentity(currentPath + "det.bin");
+        uint64_t recKey = ResultCache::fileIdentity(currentPath + "rec_" + languageUsed + ".bin");
+        modelKey = hashBytes(reinterpret_cast<const unsigned char *>(&recKey), sizeof(recKey),
+                             hashBytes(reinterpret_cast<const unsigned char *>(&detKey), sizeof(detKey)));
+        modelKeyLanguage = languageUsed;
+    }
+
+    //会影响识别结果的设置都需要参与计算
+    std::string settings = languageUsed + "|" + analyzeModeNames[static_cast<size_t>(analyzeMode)] + "|"
+                           + (adaptiveDetect ? "adaptive" : "fixed") + "|" + std::to_string(detectSide()) + "|"
+                           + std::to_string(detectCoarseSide) + "|" + std::to_string(imageDecoder.getTargetSide());
+    uint64_t hash = hashBytes(reinterpret_cast<const unsigned char *>(&imageFileKey), sizeof(imageFileKey));
+    hash = hashBytes(reinterpret_cast<const unsigned char *>(&modelKey), sizeof(modelKey), hash);
+    return hashBytes(reinterpret_cast<const unsigned char *>(settings.data()), settings.size(), hash);
+}
+
+bool PaddleOCRApp::setImageData(const unsigned char *data, size_t size)
+{
+    DecodedImage image;
+    imageDecoder.decodeData(data, size, image);
+    setDecodedImage(image);
+    return !imagePyramid.empty();
+}
+
+void PaddleOCRApp::setDecodedImage(const DecodedImage &image)
+{
+    setImage(image.mat, image.type, image.holder, false, image.scale);
+
+    //按比例解码的图片保留编码数据，识别小字时按原分辨率局部解码
+    imageSource.source = image.source;
+    imageSource.sourceData = image.sourceData;
+    imageSource.sourceSize = image.sourceSize;
+}
+
+void PaddleOCRApp::setImage(const cv::Mat &image, DeepinOCRPlugin::PixelType type, std::shared_ptr<void> holder, bool borrowed, cv::Point2f scale)
+{
+    //先释放上一张图，再设置新的数据
+    imagePyramid.clear();
+    imageFileKey = 0;
+    cachedResultKey = 0;
+    deferredFilePath.clear();
+    imageSource = DecodedImage();
+    fullRegion.release();
+    imageHolder = std::move(holder);
+    imageBorrowed = borrowed;
+    imageScale = scale;
+    imagePyramid.reset(image, type);
 }
 
 DeepinOCRPlugin::PixelType PaddleOCRApp::getPixelType()
@@ -476,7 +1249,62 @@ DeepinOCRPlugin::PixelType PaddleOCRApp::getPixelType()
 
 bool PaddleOCRApp::setMatrix(int height, int width, unsigned char *data, size_t step)
 {
-    imageCache = cv::Mat(height, width, CV_8UC3, data, step).clone();
+    setImage(cv::Mat(height, width, CV_8UC3, data, step).clone(), DeepinOCRPlugin::PixelType::Pixel_BGR, nullptr, false);
+    return true;
+}
+
+bool PaddleOCRApp::setMatrixBorrowed(int height, int width, unsigned char *data, size_t step, std::shared_ptr<void> holder)
+{
+    //整个推理过程对图像数据只读
+    setImage(cv::Mat(height, width, CV_8UC3, data, step), DeepinOCRPlugin::PixelType::Pixel_BGR, std::move(holder), true);
+    return true;
+}
+
+std::vector<DeepinOCRPlugin::PixelType> PaddleOCRApp::getPixelTypeSupportList()
+{
+    return {DeepinOCRPlugin::PixelType::Pixel_BGR,
+            DeepinOCRPlugin::PixelType::Pixel_RGB,
+            DeepinOCRPlugin::PixelType::Pixel_GRAY,
+            DeepinOCRPlugin::PixelType::Pixel_BGRA,
+            DeepinOCRPlugin::PixelType::Pixel_RGBA,
+            DeepinOCRPlugin::PixelType::Pixel_NV12,
+            DeepinOCRPlugin::PixelType::Pixel_NV21,
+            DeepinOCRPlugin::PixelType::Pixel_I420};
+}
+
+bool PaddleOCRApp::setMatrixBorrowed(int height, int width, unsigned char *data, size_t step, DeepinOCRPlugin::PixelType type, std::shared_ptr<void> holder)
+{
+    int matType;
+    int rows = height;
+    switch(type)
+    {
+    case DeepinOCRPlugin::PixelType::Pixel_BGR:
+    case DeepinOCRPlugin::PixelType::Pixel_RGB:
+        matType = CV_8UC3;
+        break;
+    case DeepinOCRPlugin::PixelType::Pixel_GRAY:
+        matType = CV_8UC1;
+        break;
+    case DeepinOCRPlugin::PixelType::Pixel_BGRA:
+    case DeepinOCRPlugin::PixelType::Pixel_RGBA:
+        matType = CV_8UC4;
+        break;
+    case DeepinOCRPlugin::PixelType::Pixel_NV12:
+    case DeepinOCRPlugin::PixelType::Pixel_NV21:
+    case DeepinOCRPlugin::PixelType::Pixel_I420:
+        if(height % 2 != 0 || width % 2 != 0) {
+            DEEPIN_LOG("the size of YUV420 image must be even");
+            return false;
+        }
+        matType = CV_8UC1;
+        rows = height * 3 / 2;
+        break;
+    default:
+        DEEPIN_LOG("unsupported pixel type");
+        return false;
+    }
+
+    setImage(cv::Mat(rows, width, matType, data, step), type, std::move(holder), true);
     return true;
 }
 
@@ -496,58 +1324,705 @@ bool PaddleOCRApp::setLanguage(const std::string &language)
     }
 }
 
+//解析整数配置值
+static bool parseInt(const std::string &value, int &result)
+{
+    char *end = nullptr;
+    errno = 0;
+    long parsed = std::strtol(value.c_str(), &end, 10);
+    if(value.empty() || *end != '\0' || errno != 0 || parsed < INT_MIN || parsed > INT_MAX) {
+        return false;
+    }
+    result = static_cast<int>(parsed);
+    return true;
+}
+
+//拼接列表值
+static std::string joinValues(const std::vector<std::string> &values)
+{
+    std::string result;
+    for(auto &value : values) {
+        if(!result.empty()) {
+            result += ",";
+        }
+        result += value;
+    }
+    return result;
+}
+
+//解析CPU列表，格式与taskset -c相同，例如"0-3,6"，空字符串表示不指定
+static bool parseCpuList(const std::string &value, std::vector<int> &result)
+{
+    result.clear();
+    size_t begin = 0;
+    while(begin < value.size()) {
+        size_t end = value.find(',', begin);
+        if(end == std::string::npos) {
+            end = value.size();
+        }
+
+        std::string item = value.substr(begin, end - begin);
+        size_t dash = item.find('-');
+        int first = 0;
+        int last = 0;
+        if(dash == std::string::npos) {
+            if(!parseInt(item, first) || first < 0) {
+                return false;
+            }
+            last = first;
+        } else if(!parseInt(item.substr(0, dash), first) || !parseInt(item.substr(dash + 1), last) || first < 0 || last < first) {
+            return false;
+        }
+
+        for(int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu) {
+            result.push_back(cpu);
+        }
+        begin = end + 1;
+    }
+
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return true;
+}
+
+bool PaddleOCRApp::setValue(const std::string &key, const std::string &value)
+{
+    int intValue = 0;
+    if(key == "decodeTargetSide") {
+        if(!parseInt(value, intValue) || intValue < 0) {
+            return false;
+        }
+        imageDecoder.setTargetSide(intValue);
+        return true;
+    } else if(key == "analyzeMode") {
+        auto iter = std::find(analyzeModeNames.begin(), analyzeModeNames.end(), value);
+        if(iter == analyzeModeNames.end()) {
+            return false;
+        }
+        analyzeMode = static_cast<AnalyzeMode>(iter - analyzeModeNames.begin());
+        return true;
+    } else if(key == "resultCache") {
+        if(value != "0" && value != "1") {
+            return false;
+        }
+        resultCache->setEnabled(value == "1");
+        return true;
+    } else if(key == "resultCacheDir") {
+        resultCache->setDirectory(value);
+        return true;
+    } else if(key == "resultCacheCapacityMB") {
+        if(!parseInt(value, intValue) || intValue <= 0) {
+            return false;
+        }
+        resultCache->setCapacity(static_cast<uint64_t>(intValue) * 1024 * 1024);
+        return true;
+    } else if(key == "analyzeBudgetMs") {
+        if(!parseInt(value, intValue) || intValue < 0) {
+            return false;
+        }
+        analyzeBudgetMs = intValue;
+        return true;
+    } else if(key == "recCacheCapacity") {
+        if(!parseInt(value, intValue) || intValue < 0) {
+            return false;
+        }
+        recCache.setCapacity(static_cast<size_t>(intValue));
+        return true;
+    } else if(key == "maxThreads") {
+        if(value == "auto") {
+            maxThreadsUsed = 0;
+            return true;
+        }
+        if(!parseInt(value, intValue) || intValue < 0) {
+            return false;
+        }
+        maxThreadsUsed = static_cast<unsigned int>(intValue);
+        return true;
+    } else if(key == "loadAwareThreads") {
+        if(value != "0" && value != "1") {
+            return false;
+        }
+        loadAwareThreads = value == "1";
+        return true;
+    } else if(key == "autotune") {
+        //1为开启，run为开启并重新调优，0为关闭
+        if(value != "0" && value != "1" && value != "run") {
+            return false;
+        }
+        autotuneEnabled = value != "0";
+        autotunePending = autotuneEnabled;
+        if(value == "run") {
+            AutoTuner::requestRerun();
+        }
+        return true;
+    } else if(key == "cpuProfile") {
+        auto iter = std::find(cpuProfileNames.begin(), cpuProfileNames.end(), value);
+        if(iter == cpuProfileNames.end()) {
+            return false;
+        }
+        cpuProfile = static_cast<CpuProfile>(iter - cpuProfileNames.begin());
+        return true;
+    } else if(key == "cpuMask") {
+        std::vector<int> cpus;
+        if(!parseCpuList(value, cpus)) {
+            return false;
+        }
+        cpuMask = std::move(cpus);
+        return true;
+    } else if(key == "incremental") {
+        if(value != "0" && value != "1") {
+            return false;
+        }
+        incrementalMode = value == "1";
+        lastFrame.tileHashes.clear();
+        return true;
+    } else if(key == "detectMode") {
+        if(value != "fixed" && value != "adaptive") {
+            return false;
+        }
+        adaptiveDetect = value == "adaptive";
+        return true;
+    } else if(key == "detectMaxSide" || key == "detectCoarseSide" || key == "probeSide") {
+        if(!parseInt(value, intValue) || intValue < 64) {
+            return false;
+        }
+        if(key == "detectMaxSide") {
+            detectMaxSide = intValue;
+        } else if(key == "detectCoarseSide") {
+            detectCoarseSide = intValue;
+        } else {
+            probeSide = intValue;
+        }
+        return true;
+    }
+
+    DEEPIN_LOG("unknown key: %s", key.c_str());
+    return false;
+}
+
+std::string PaddleOCRApp::getValue(const std::string &key)
+{
+    if(key == "decodeTargetSide") {
+        return std::to_string(imageDecoder.getTargetSide());
+    } else if(key == "analyzeMode") {
+        return analyzeModeNames[static_cast<size_t>(analyzeMode)];
+    } else if(key == "resultCache") {
+        return resultCache->enabled() ? "1" : "0";
+    } else if(key == "resultCacheDir") {
+        return resultCache->directory();
+    } else if(key == "resultCacheCapacityMB") {
+        return std::to_string(resultCache->capacity() / 1024 / 1024);
+    } else if(key == "analyzeBudgetMs") {
+        return std::to_string(analyzeBudgetMs);
+    } else if(key == "resultPartial") {
+        return resultPartial ? "1" : "0";
+    } else if(key == "recCacheCapacity") {
+        return std::to_string(recCache.capacity());
+    } else if(key == "recCacheUsage") {
+        return std::to_string(recCache.usage());
+    } else if(key == "recCacheHits") {
+        return std::to_string(recCache.hits());
+    } else if(key == "recCacheMisses") {
+        return std::to_string(recCache.misses());
+    } else if(key == "maxThreads") {
+        return maxThreadsUsed == 0 ? "auto" : std::to_string(maxThreadsUsed);
+    } else if(key == "loadAwareThreads") {
+        return loadAwareThreads ? "1" : "0";
+    } else if(key == "autotune") {
+        return autotuneEnabled ? "1" : "0";
+    } else if(key == "autotuneResult") {
+        //格式为"网络选项;各尺寸分类的检测线程数/识别线程数"，尺寸分类之间以逗号分隔，没有调优结果时为空
+        if(!tuneResult.valid) {
+            return "";
+        }
+        std::vector<std::string> threads;
+        for(int i = 0; i < TuneResult::SizeClassCount; ++i) {
+            threads.push_back(std::to_string(tuneResult.detThreads[i]) + "/" + std::to_string(tuneResult.recThreads[i]));
+        }
+        return tuneResult.options.key() + ";" + joinValues(threads);
+    } else if(key == "cpuProfile") {
+        return cpuProfileNames[static_cast<size_t>(cpuProfile)];
+    } else if(key == "cpuMask") {
+        std::vector<std::string> cpus;
+        for(auto cpu : cpuMask) {
+            cpus.push_back(std::to_string(cpu));
+        }
+        return joinValues(cpus);
+    } else if(key == "boundCpus") {
+        std::vector<std::string> cpus;
+        for(auto cpu : affinityCpus) {
+            cpus.push_back(std::to_string(cpu));
+        }
+        return joinValues(cpus);
+    } else if(key == "detThreads") {
+        return std::to_string(detThreadsUsed);
+    } else if(key == "recThreads") {
+        return std::to_string(recThreadsUsed);
+    } else if(key == "detThreadsGranted") {
+        return std::to_string(detThreadsGranted);
+    } else if(key == "recThreadsGranted") {
+        return std::to_string(recThreadsGranted);
+    } else if(key == "threadBudget") {
+        return std::to_string(DeepinOCRPlugin::ThreadBudget::instance().capacity());
+    } else if(key == "threadBudgetInUse") {
+        return std::to_string(DeepinOCRPlugin::ThreadBudget::instance().inUse());
+    } else if(key == "availableCpus") {
+        return std::to_string(availableCpus);
+    } else if(key == "cpuQuota") {
+        return std::to_string(getCgroupCpuQuota());
+    } else if(key == "incremental") {
+        return incrementalMode ? "1" : "0";
+    } else if(key == "changedBoxIndexes") {
+        std::vector<std::string> indexes;
+        for(size_t i = 0; i != lineChanged.size(); ++i) {
+            if(lineChanged[i]) {
+                indexes.push_back(std::to_string(i));
+            }
+        }
+        return joinValues(indexes);
+    } else if(key == "detectMode") {
+        return adaptiveDetect ? "adaptive" : "fixed";
+    } else if(key == "detectMaxSide") {
+        return std::to_string(detectMaxSide);
+    } else if(key == "detectCoarseSide") {
+        return std::to_string(detectCoarseSide);
+    } else if(key == "probeSide") {
+        return std::to_string(probeSide);
+    } else if(key == "decoderBackends") {
+        return joinValues(imageDecoder.backendNames());
+    }
+
+    DEEPIN_LOG("unknown key: %s", key.c_str());
+    return "";
+}
+
+//宽高比不小于该值且高度不超过SingleLineMaxHeight的图片视为单行文本
+static constexpr float SingleLineMinAspect = 6.0f;
+static constexpr int SingleLineMaxHeight = 96;
+
+bool PaddleOCRApp::isSingleLineImage() const
+{
+    cv::Size size = imagePyramid.size();
+    return size.height <= SingleLineMaxHeight && size.width >= size.height * SingleLineMinAspect;
+}
+
+std::vector<std::vector<int>> PaddleOCRApp::wholeImageBox() const
+{
+    cv::Size size = imagePyramid.size();
+    int right = size.width - 1;
+    int bottom = size.height - 1;
+    return {{0, 0}, {right, 0}, {right, bottom}, {0, bottom}};
+}
+
+std::vector<std::vector<std::vector<int>>> PaddleOCRApp::callerBoxes() const
+{
+    std::vector<std::vector<std::vector<int>>> boxes;
+    if(recognizeBoxes.empty()) {
+        boxes.push_back(wholeImageBox());
+        return boxes;
+    }
+
+    //调用方的坐标基于原图，按比例解码时需要换算到当前图像上
+    //截断后过小的文本框仍保留在原位置，使结果与调用方的文本框一一对应，裁切时按空结果处理
+    cv::Size size = imagePyramid.size();
+    for(auto &textBox : recognizeBoxes) {
+        std::vector<std::vector<int>> box;
+        for(auto &point : textBox.points) {
+            int x = static_cast<int>(point.first * imageScale.x);
+            int y = static_cast<int>(point.second * imageScale.y);
+            box.push_back({std::clamp(x, 0, size.width - 1), std::clamp(y, 0, size.height - 1)});
+        }
+        boxes.push_back(box);
+    }
+    return boxes;
+}
+
+bool PaddleOCRApp::setRegionsOfInterest(const std::vector<DeepinOCRPlugin::ImageRect> &regions)
+{
+    for(auto &region : regions) {
+        if(region.width <= 0 || region.height <= 0) {
+            DEEPIN_LOG("region of interest is empty");
+            return false;
+        }
+    }
+
+    regionsOfInterest = regions;
+    return true;
+}
+
+bool PaddleOCRApp::setRecognizeBoxes(const std::vector<DeepinOCRPlugin::TextBox> &boxes)
+{
+    for(auto &box : boxes) {
+        if(box.points.size() != 4) {
+            DEEPIN_LOG("text box must have 4 points");
+            return false;
+        }
+    }
+
+    recognizeBoxes = boxes;
+    return true;
+}
+
+//文本框的阅读顺序：先上下，后左右
+static bool readingOrderLess(const std::vector<std::vector<int>> &boxL, const std::vector<std::vector<int>> &boxR)
+{
+    //左侧
+    int x_collect_L[4] = {boxL[0][0], boxL[1][0], boxL[2][0], boxL[3][0]};
+    int y_collect_L[4] = {boxL[0][1], boxL[1][1], boxL[2][1], boxL[3][1]};
+
+    //右侧
+    int x_collect_R[4] = {boxR[0][0], boxR[1][0], boxR[2][0], boxR[3][0]};
+    int y_collect_R[4] = {boxR[0][1], boxR[1][1], boxR[2][1], boxR[3][1]};
+
+    //判断顺序：先上下，后左右
+
+    //完全超过时，在上面的靠前，在下面的靠后
+    int y_L = *std::min_element(y_collect_L, y_collect_L + 4);
+    int height_L = *std::max_element(y_collect_L, y_collect_L + 4) - y_L;
+    int y_R = *std::min_element(y_collect_R, y_collect_R + 4);
+    int height_R = *std::max_element(y_collect_R, y_collect_R + 4) - y_R;
+    if (y_R - y_L > height_R / 3.0f * 2.0f) {
+        return true;
+    } else if (y_L - y_R > height_L / 3.0f * 2.0f) {
+        return false;
+    }
+
+    //部分超过时，在左边的靠前，在右边的靠后（TODO：如果是维语/阿拉伯语，则需要反过来）
+    //注意：由于检测算法的机制，各个矩形框按理来说不会出现重叠
+    int x_L = *std::min_element(x_collect_L, x_collect_L + 4);
+    int x_R = *std::min_element(x_collect_R, x_collect_R + 4);
+    if (x_L < x_R) {
+        return true;
+    } else {
+        return false;
+    }
+}
+
+//增量模式下比较图像时的分块尺寸
+static constexpr int IncrementalTileSize = 64;
+
+bool PaddleOCRApp::incrementalEnabled() const
+{
+    return incrementalMode && regionsOfInterest.empty()
+           && (analyzeMode == AnalyzeMode::Full || analyzeMode == AnalyzeMode::Auto);
+}
+
+bool PaddleOCRApp::lastFrameMatches() const
+{
+    return !lastFrame.tileHashes.empty() && lastFrame.size == imagePyramid.size()
+           && lastFrame.type == imagePyramid.type() && lastFrame.scale == imageScale;
+}
+
+std::vector<uint64_t> PaddleOCRApp::computeTileHashes()
+{
+    cv::Mat image = imagePyramid.level(0);
+    cv::Size size = imagePyramid.size();
+    size_t elemSize = image.elemSize();
+    int tileCols = (size.width + IncrementalTileSize - 1) / IncrementalTileSize;
+    int tileRows = (size.height + IncrementalTileSize - 1) / IncrementalTileSize;
+    std::vector<uint64_t> hashes(static_cast<size_t>(tileCols * tileRows), 0xcbf29ce484222325ULL);
+
+    //逐行遍历，保证按内存顺序访问；YUV格式只比较Y平面
+    for(int y = 0; y < size.height; ++y) {
+        const unsigned char *row = image.ptr(y);
+        uint64_t *rowHashes = hashes.data() + static_cast<size_t>(y / IncrementalTileSize * tileCols);
+        for(int tileX = 0; tileX < tileCols; ++tileX) {
+            int x = tileX * IncrementalTileSize;
+            int width = std::min(IncrementalTileSize, size.width - x);
+            rowHashes[tileX] = hashBytes(row + static_cast<size_t>(x) * elemSize, static_cast<size_t>(width) * elemSize, rowHashes[tileX]);
+        }
+    }
+
+    return hashes;
+}
+
+std::vector<std::vector<std::vector<int>>> PaddleOCRApp::detectChanged(const std::vector<uint64_t> &tileHashes, std::vector<int> &reuseLines,
+                                                                      float thresh, float boxThresh, float unclipRatio)
+{
+    cv::Size size = imagePyramid.size();
+    cv::Rect fullRect(cv::Point(0, 0), size);
+    int tileCols = (size.width + IncrementalTileSize - 1) / IncrementalTileSize;
+
+    //变化的分块向外扩展一个分块，使跨越分块边界的新文本能被完整检测
+    std::vector<cv::Rect> regions;
+    for(size_t i = 0; i != tileHashes.size(); ++i) {
+        if(tileHashes[i] == lastFrame.tileHashes[i]) {
+            continue;
+        }
+        int x = static_cast<int>(i % static_cast<size_t>(tileCols)) * IncrementalTileSize;
+        int y = static_cast<int>(i / static_cast<size_t>(tileCols)) * IncrementalTileSize;
+        cv::Rect tile(x - IncrementalTileSize, y - IncrementalTileSize, IncrementalTileSize * 3, IncrementalTileSize * 3);
+        regions.push_back(tile & fullRect);
+    }
+
+    //与变化区域相交的上一帧文本行需要整行重新检测，区域扩大后可能再与其他文本行相交，直到不再变化
+    std::vector<cv::Rect> lastRects;
+    for(auto &textBox : lastFrame.textBoxes) {
+        lastRects.push_back(boxBoundingRect(textBoxToBox(textBox)));
+    }
+    std::vector<bool> lastInvalid(lastRects.size(), false);
+    bool grown = !regions.empty();
+    while(grown) {
+        grown = false;
+        mergeRegions(regions);
+        for(size_t i = 0; i != lastRects.size(); ++i) {
+            if(lastInvalid[i]) {
+                continue;
+            }
+            for(auto &region : regions) {
+                if((region & lastRects[i]).area() > 0) {
+                    lastInvalid[i] = true;
+                    regions.push_back(lastRects[i] | region);
+                    grown = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    //变化的区域过大时，直接整图重新检测更划算
+    long long changedArea = 0;
+    for(auto &region : regions) {
+        changedArea += region.area();
+    }
+    if(changedArea * 2 > static_cast<long long>(fullRect.area())) {
+        reuseLines.clear();
+        return detect(thresh, boxThresh, unclipRatio);
+    }
+
+    //未变化的文本行直接复用
+    std::vector<std::vector<std::vector<int>>> boxes;
+    reuseLines.clear();
+    for(size_t i = 0; i != lastRects.size(); ++i) {
+        if(!lastInvalid[i]) {
+            boxes.push_back(textBoxToBox(lastFrame.textBoxes[i]));
+            reuseLines.push_back(static_cast<int>(i));
+        }
+    }
+
+    //变化的区域重新检测
+    for(auto &region : regions) {
+        auto regionBoxes = detectArea(region, thresh, boxThresh, unclipRatio);
+        if(stopRequested()) {
+            return std::vector<std::vector<std::vector<int>>>();
+        }
+        boxes.insert(boxes.end(), regionBoxes.begin(), regionBoxes.end());
+        reuseLines.resize(boxes.size(), -1);
+    }
+
+    return boxes;
+}
+
+bool PaddleOCRApp::stopRequested()
+{
+    //超过时间预算时按终止处理
+    if(!needBreak && hasDeadline && std::chrono::steady_clock::now() >= deadline) {
+        needBreak = true;
+    }
+    return needBreak;
+}
+
+float PaddleOCRApp::remainingMs() const
+{
+    std::chrono::duration<float, std::milli> remaining = deadline - std::chrono::steady_clock::now();
+    return remaining.count();
+}
+
+bool PaddleOCRApp::setAnalyzeCallbacks(const DeepinOCRPlugin::AnalyzeCallbacks &analyzeCallbacks)
+{
+    callbacks = analyzeCallbacks;
+    return true;
+}
+
+std::shared_ptr<DeepinOCRPlugin::Plugin> PaddleOCRApp::createSession()
+{
+    //会话与当前插件共享模型，复制当前的设置，图像、结果和回调相互独立
+    auto session = std::make_shared<PaddleOCRApp>(sharedModels, currentPath);
+    session->hardwareUseInfos = hardwareUseInfos;
+    session->languageUsed = languageUsed;
+    session->maxThreadsUsed = maxThreadsUsed;
+    session->loadAwareThreads = loadAwareThreads;
+    session->cpuProfile = cpuProfile;
+    session->cpuMask = cpuMask;
+    session->autotuneEnabled = autotuneEnabled;
+    session->autotunePending = autotuneEnabled; //调优结果在进程内共享，会话初始化时直接取用
+    session->tuneResult = tuneResult;
+    session->analyzeBudgetMs = analyzeBudgetMs;
+    session->imageDecoder.setTargetSide(imageDecoder.getTargetSide());
+    session->adaptiveDetect = adaptiveDetect;
+    session->detectMaxSide = detectMaxSide;
+    session->detectCoarseSide = detectCoarseSide;
+    session->probeSide = probeSide;
+    session->analyzeMode = analyzeMode;
+    session->recognizeBoxes = recognizeBoxes;
+    session->regionsOfInterest = regionsOfInterest;
+    session->recCache.setCapacity(recCache.capacity());
+    session->resultCache = resultCache; //磁盘缓存只有一份，各会话共用同一个实例
+    session->incrementalMode = incrementalMode;
+    return session;
+}
+
+void PaddleOCRApp::emitBoxes(cv::Point2f scale)
+{
+    emitScale = scale;
+    if(!callbacks.onBoxesDetected) {
+        return;
+    }
+
+    auto boxes = textBoxes;
+    for(auto &box : boxes) {
+        for(auto &point : box.points) {
+            point.first /= scale.x;
+            point.second /= scale.y;
+        }
+    }
+    callbacks.onBoxesDetected(boxes);
+}
+
+void PaddleOCRApp::beginLineEmission()
+{
+    std::lock_guard<std::mutex> locker(emitMutex);
+    nextEmitLine = 0;
+    lineDone.assign(lineChanged.size(), 0);
+    for(size_t i = 0; i != lineChanged.size(); ++i) {
+        lineDone[i] = lineChanged[i] ? 0 : 1;
+    }
+    flushFinishedLines();
+}
+
+void PaddleOCRApp::lineFinished(size_t index)
+{
+    std::lock_guard<std::mutex> locker(emitMutex);
+    lineDone[index] = 1;
+    flushFinishedLines();
+}
+
+void PaddleOCRApp::flushFinishedLines()
+{
+    if(!callbacks.onLineRecognized) {
+        return;
+    }
+
+    //按阅读顺序输出，前面的文本行未完成时后面的文本行先等待
+    while(nextEmitLine < lineDone.size() && lineDone[nextEmitLine] != 0) {
+        size_t index = nextEmitLine++;
+        DeepinOCRPlugin::TextBox box = textBoxes[index];
+        for(auto &point : box.points) {
+            point.first /= emitScale.x;
+            point.second /= emitScale.y;
+        }
+
+        std::vector<DeepinOCRPlugin::TextBox> lineCharBoxes;
+        if(index < charBoxesBuilt.size() && charBoxesBuilt[index]) {
+            lineCharBoxes = charBoxes[index];
+        } else {
+            lineCharBoxes = lengthToBox(charLengths[index], box.points[0], box.points[2].second - box.points[0].second, charRatios[index] * emitScale.x);
+        }
+        callbacks.onLineRecognized(index, boxesResult[index], lineCharBoxes);
+    }
+}
+
 bool PaddleOCRApp::analyze()
 {
+    //之后会修改结果，尚未生成快照的上一次结果先移交出去
+    detachSnapshotSource();
+
+    //由文件设置的图像可以使用磁盘缓存，只识别和感兴趣区域的结果与调用方的输入有关，不使用缓存
+    bool useResultCache = imageFileKey != 0 && regionsOfInterest.empty() && analyzeMode != AnalyzeMode::Recognize;
+    uint64_t cacheKey = useResultCache ? resultKey() : 0;
+    if(useResultCache && (cachedResultKey == cacheKey || resultCache->load(cacheKey, cachedResult))) {
+        cachedResultKey = cacheKey;
+        clearResults();
+        textBoxes = cachedResult.textBoxes;
+        boxesResult = cachedResult.boxesResult;
+        charBoxes = cachedResult.charBoxes;
+        charBoxesBuilt.assign(textBoxes.size(), true);
+        lineChanged.assign(textBoxes.size(), true);
+        resultPartial = false;
+        emitBoxes(cv::Point2f(1.0f, 1.0f));
+        charLengths.assign(textBoxes.size(), std::vector<int>());
+        charRatios.assign(textBoxes.size(), 1.0f);
+
+        //缓存的文本行全部已完成，按顺序逐行回调
+        beginLineEmission();
+        for(size_t i = 0; i != textBoxes.size(); ++i) {
+            lineFinished(i);
+        }
+        markSnapshotPending();
+        needBreak = false;
+        return !textBoxes.empty();
+    }
+
+    //时间预算覆盖整个analyze，包括解码和模型加载
+    hasDeadline = analyzeBudgetMs > 0;
+    deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(analyzeBudgetMs);
+    resultDegraded = false;
+
+    ensureImage();
+
     //初始化
     if (needReset) {
         resetNet();
     }
     initNet();
+    ThreadPinning pinning(affinityCpus);
 
-    do {
-        //检测
-        auto boxes = detect(imageCache, 0.3f, 0.5f, 1.6f);
+    lineDone.clear();
+
+    //增量模式下先计算分块哈希，与上一帧比较后只重新处理变化的部分
+    bool incremental = incrementalEnabled();
 
-        if(needBreak) {
+    do {
+        if(imagePyramid.empty()) {
+            DEEPIN_LOG("image is not set");
+            clearResults();
             break;
         }
 
-        //排序
-        std::sort(boxes.begin(), boxes.end(), [](const std::vector<std::vector<int>> &boxL, const std::vector<std::vector<int>> &boxR) {
-            //左侧
-            int x_collect_L[4] = {boxL[0][0], boxL[1][0], boxL[2][0], boxL[3][0]};
-            int y_collect_L[4] = {boxL[0][1], boxL[1][1], boxL[2][1], boxL[3][1]};
-
-            //右侧
-            int x_collect_R[4] = {boxR[0][0], boxR[1][0], boxR[2][0], boxR[3][0]};
-            int y_collect_R[4] = {boxR[0][1], boxR[1][1], boxR[2][1], boxR[3][1]};
+        std::vector<uint64_t> tileHashes;
+        if(incremental) {
+            tileHashes = computeTileHashes();
+        }
 
-            //判断顺序：先上下，后左右
+        std::vector<std::vector<std::vector<int>>> boxes;
+        std::vector<int> reuseLines; //每个文本框复用的上一帧文本行编号，-1表示需要重新识别
+        if(analyzeMode == AnalyzeMode::Recognize) {
+            //只识别：使用调用方给出的文本框，保持调用方的顺序，未给出时整张图作为一行
+            boxes = callerBoxes();
+        } else if(analyzeMode == AnalyzeMode::Auto && isSingleLineImage()) {
+            //单行图片的快速路径：直接整张图识别，跳过检测
+            boxes.push_back(wholeImageBox());
+        } else {
+            //检测
+            if(incremental && lastFrameMatches()) {
+                boxes = detectChanged(tileHashes, reuseLines, 0.3f, 0.5f, 1.6f);
+            } else {
+                boxes = detect(0.3f, 0.5f, 1.6f);
+            }
 
-            //完全超过时，在上面的靠前，在下面的靠后
-            int y_L = *std::min_element(y_collect_L, y_collect_L + 4);
-            int height_L = *std::max_element(y_collect_L, y_collect_L + 4) - y_L;
-            int y_R = *std::min_element(y_collect_R, y_collect_R + 4);
-            int height_R = *std::max_element(y_collect_R, y_collect_R + 4) - y_R;
-            if (y_R - y_L > height_R / 3.0f * 2.0f) {
-                return true;
-            } else if (y_L - y_R > height_L / 3.0f * 2.0f) {
-                return false;
+            if(stopRequested()) {
+                break;
             }
 
-            //部分超过时，在左边的靠前，在右边的靠后（TODO：如果是维语/阿拉伯语，则需要反过来）
-            //注意：由于检测算法的机制，各个矩形框按理来说不会出现重叠
-            int x_L = *std::min_element(x_collect_L, x_collect_L + 4);
-            int x_R = *std::min_element(x_collect_R, x_collect_R + 4);
-            if (x_L < x_R) {
-                return true;
-            } else {
-                return false;
+            //排序，复用标记随文本框一起调整顺序
+            std::vector<size_t> order(boxes.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&boxes](size_t left, size_t right) {
+                return readingOrderLess(boxes[left], boxes[right]);
+            });
+
+            std::vector<std::vector<std::vector<int>>> sortedBoxes;
+            std::vector<int> sortedReuseLines;
+            for(auto index : order) {
+                sortedBoxes.push_back(std::move(boxes[index]));
+                sortedReuseLines.push_back(reuseLines.empty() ? -1 : reuseLines[index]);
             }
-        });
+            boxes = std::move(sortedBoxes);
+            reuseLines = std::move(sortedReuseLines);
 
-        if(needBreak) {
-            break;
+            if(stopRequested()) {
+                break;
+            }
         }
 
         //整理成可输出的格式
@@ -581,44 +2056,268 @@ bool PaddleOCRApp::analyze()
             textBoxes.push_back(temp);
         }
 
-        if(needBreak) {
+        if(stopRequested()) {
+            break;
+        }
+
+        emitBoxes(imageScale);
+
+        //只检测：不裁切也不识别，各文本框的识别结果留空
+        if(analyzeMode == AnalyzeMode::Detect) {
+            boxesResult.assign(textBoxes.size(), std::string());
+            charLengths.assign(textBoxes.size(), std::vector<int>());
+            charRatios.assign(textBoxes.size(), 1.0f);
+            lineChanged.assign(textBoxes.size(), true);
             break;
         }
 
-        //裁切
+        //复用上一帧中未变化的文本行，其余的文本行需要识别
+        reuseLines.resize(boxes.size(), -1);
+        boxesResult.assign(boxes.size(), std::string());
+        charLengths.assign(boxes.size(), std::vector<int>());
+        charRatios.assign(boxes.size(), 1.0f);
+        lineChanged.assign(boxes.size(), true);
+        charBoxes.clear();
+        charBoxesBuilt.clear();
+        for(size_t i = 0; i != boxes.size(); ++i) {
+            if(reuseLines[i] >= 0) {
+                auto lastLine = static_cast<size_t>(reuseLines[i]);
+                boxesResult[i] = lastFrame.boxesResult[lastLine];
+                charLengths[i] = lastFrame.charLengths[lastLine];
+                charRatios[i] = lastFrame.charRatios[lastLine];
+                lineChanged[i] = false;
+            }
+        }
+
+        //复用的文本行视为已完成，逐行回调从第一行开始按顺序输出
+        beginLineEmission();
+
+        //裁切，复用的文本行留空
+        prepareFullResolution(boxes);
+        //过小的文本框（如调用方给出的、被截断到图像边缘的文本框）无法裁切识别，直接作为空结果完成
         std::vector<cv::Mat> images;
-        std::transform(boxes.begin(), boxes.end(), std::back_inserter(images), [this](const std::vector<std::vector<int>> &box) {
-            return utilityTool.GetRotateCropImage(imageCache, box);
-        });
+        std::vector<float> cropScales(boxes.size(), 1.0f);
+        for(size_t i = 0; i != boxes.size(); ++i) {
+            cv::Mat image;
+            if(lineChanged[i]) {
+                if(!isDegenerateBox(boxes[i])) {
+                    image = cropLine(boxes[i], cropScales[i]);
+                }
+                if(image.empty()) {
+                    lineFinished(i);
+                }
+            }
+            images.push_back(image);
+        }
 
-        if(needBreak) {
+        if(stopRequested()) {
             break;
         }
 
         //识别
-        rec(images);
+        rec(images, cropScales);
+        fullRegion.release();
+
+        //记录本帧的分块哈希，结果在清理之后记录
+        if(incremental) {
+            lastFrame.size = imagePyramid.size();
+            lastFrame.type = imagePyramid.type();
+            lastFrame.scale = imageScale;
+            lastFrame.tileHashes = std::move(tileHashes);
+        }
     }while(0);
 
-    if(needBreak) {
-        textBoxes.clear();
-        charBoxes.clear();
-        allResult.clear();
-        boxesResult.clear();
+    //借用模式下外部数据只保证在analyze返回前有效，这里将其归还给调用方
+    if(imageBorrowed) {
+        setImage(cv::Mat(), DeepinOCRPlugin::PixelType::Pixel_Unknown, nullptr, false);
+    }
+
+    //终止或超时时保留已经识别完成的文本行，结果标记为不完整
+    hasDeadline = false;
+    resultPartial = needBreak;
+    if(resultPartial) {
+        lastFrame.tileHashes.clear();
+        if(lineDone.size() != boxesResult.size() || analyzeMode == AnalyzeMode::Detect) {
+            clearResults();
+        }
         needBreak = false;
-        return false;
-    } else {
-        //对识别结果进行最后清理，将未识别到文字的检测框排除掉
-        for(uint32_t i = 0;i != boxesResult.size();++i) {
+    }
+
+    //分块检测或分段识别的结果不作为后续增量识别的参照
+    if(resultDegraded) {
+        lastFrame.tileHashes.clear();
+    }
+
+    //对识别结果进行最后清理，将未识别到文字的检测框排除掉
+    //只检测时没有识别结果，只识别时需要与调用方的文本框一一对应，这两种情况不做清理
+    //一次遍历完成压缩，保留的文本行依次前移
+    if(analyzeMode != AnalyzeMode::Detect && analyzeMode != AnalyzeMode::Recognize) {
+        size_t kept = 0;
+        for(size_t i = 0; i != boxesResult.size(); ++i) {
             if(boxesResult[i].empty()) {
-                boxesResult.erase(boxesResult.begin() + i);
-                textBoxes.erase(textBoxes.begin() + i);
-                charBoxes.erase(charBoxes.begin() + i);
-                --i;
+                continue;
+            }
+            if(kept != i) {
+                boxesResult[kept] = std::move(boxesResult[i]);
+                textBoxes[kept] = std::move(textBoxes[i]);
+                charLengths[kept] = std::move(charLengths[i]);
+                charRatios[kept] = charRatios[i];
+                lineChanged[kept] = lineChanged[i];
             }
+            ++kept;
         }
+        boxesResult.resize(kept);
+        textBoxes.resize(kept);
+        charLengths.resize(kept);
+        charRatios.resize(kept);
+        lineChanged.resize(kept);
+    }
 
-        return !textBoxes.empty();
+    //记录本帧的结果，坐标为换算回原图之前的坐标
+    if(incremental && !resultPartial && !lastFrame.tileHashes.empty()) {
+        lastFrame.textBoxes = textBoxes;
+        lastFrame.boxesResult = boxesResult;
+        lastFrame.charLengths = charLengths;
+        lastFrame.charRatios = charRatios;
+    }
+
+    //按比例解码的图像，坐标需要换算回原图
+    if(imageScale != cv::Point2f(1.0f, 1.0f)) {
+        auto scaleBox = [this](DeepinOCRPlugin::TextBox &box) {
+            for(auto &point : box.points) {
+                point.first /= imageScale.x;
+                point.second /= imageScale.y;
+            }
+        };
+        std::for_each(textBoxes.begin(), textBoxes.end(), scaleBox);
+        for(auto &ratio : charRatios) {
+            ratio *= imageScale.x;
+        }
+    }
+
+    //字符位置和总体结果在第一次获取时才生成
+    charBoxes.assign(textBoxes.size(), std::vector<DeepinOCRPlugin::TextBox>());
+    charBoxesBuilt.assign(textBoxes.size(), false);
+    allResult.clear();
+    allResultBuilt = false;
+
+    //写入磁盘缓存，分块检测或分段识别的结果质量较低，不写入
+    if(useResultCache && !resultPartial && !resultDegraded) {
+        cachedResult.textBoxes = textBoxes;
+        cachedResult.charBoxes.clear();
+        for(size_t i = 0; i != textBoxes.size(); ++i) {
+            cachedResult.charBoxes.push_back(getCharBoxes(i));
+        }
+        cachedResult.boxesResult = boxesResult;
+        if(resultCache->store(cacheKey, cachedResult)) {
+            cachedResultKey = cacheKey;
+        }
+    }
+
+    markSnapshotPending();
+    return !textBoxes.empty();
+}
+
+//文本探测时统计特征所用的灰度图长边尺寸
+static constexpr int ProbeStatSide = 256;
+
+//灰度标准差低于该值的图像视为纯色图，不可能含有文字
+static constexpr double ProbeMinStdDev = 8.0;
+
+//横向梯度超过ProbeEdgeThresh的像素占比低于该值时，视为没有文字
+static constexpr int ProbeEdgeThresh = 48;
+static constexpr double ProbeMinEdgeDensity = 0.005;
+
+//转换为灰度图，YUV格式直接取Y平面
+static cv::Mat toGray(const cv::Mat &src, DeepinOCRPlugin::PixelType type)
+{
+    cv::Mat gray;
+    switch (type) {
+    case DeepinOCRPlugin::PixelType::Pixel_GRAY:
+        gray = src;
+        break;
+    case DeepinOCRPlugin::PixelType::Pixel_RGB:
+        cv::cvtColor(src, gray, cv::COLOR_RGB2GRAY);
+        break;
+    case DeepinOCRPlugin::PixelType::Pixel_BGR:
+        cv::cvtColor(src, gray, cv::COLOR_BGR2GRAY);
+        break;
+    case DeepinOCRPlugin::PixelType::Pixel_RGBA:
+        cv::cvtColor(src, gray, cv::COLOR_RGBA2GRAY);
+        break;
+    case DeepinOCRPlugin::PixelType::Pixel_BGRA:
+        cv::cvtColor(src, gray, cv::COLOR_BGRA2GRAY);
+        break;
+    default:
+        gray = src.rowRange(0, src.rows * 2 / 3);
+        break;
     }
+    return gray;
+}
+
+bool PaddleOCRApp::probeText(float &coverage)
+{
+    coverage = 0.0f;
+
+    if(!ensureImage()) {
+        DEEPIN_LOG("image is not set");
+        return false;
+    }
+
+    cv::Size srcSize = imagePyramid.size();
+    int srcSide = std::max(srcSize.width, srcSize.height);
+
+    //1.统计特征筛选：取一张很小的灰度图，纯色图或几乎没有边缘的图直接判定为无文字
+    float statScale = std::min(1.0f, static_cast<float>(ProbeStatSide) / srcSide);
+    cv::Mat gray = toGray(imagePyramid.level(imagePyramid.levelForScale(statScale)), imagePyramid.type());
+    if(std::max(gray.cols, gray.rows) > ProbeStatSide) {
+        float resizeScale = static_cast<float>(ProbeStatSide) / std::max(gray.cols, gray.rows);
+        cv::Mat small;
+        cv::resize(gray, small, cv::Size(), resizeScale, resizeScale, cv::INTER_AREA);
+        gray = small;
+    }
+
+    cv::Scalar mean, stdDev;
+    cv::meanStdDev(gray, mean, stdDev);
+    if(stdDev[0] < ProbeMinStdDev) {
+        return false;
+    }
+
+    //文字的笔画会带来密集的横向梯度
+    cv::Mat gradX;
+    cv::Sobel(gray, gradX, CV_16S, 1, 0);
+    cv::convertScaleAbs(gradX, gradX);
+    cv::threshold(gradX, gradX, ProbeEdgeThresh, 255, cv::THRESH_BINARY);
+    double edgeDensity = static_cast<double>(cv::countNonZero(gradX)) / static_cast<double>(gradX.total());
+    if(edgeDensity < ProbeMinEdgeDensity) {
+        return false;
+    }
+
+    if(needBreak) {
+        needBreak = false;
+        return false;
+    }
+
+    //2.低分辨率检测，以检测框的面积估算文字的覆盖率
+    if (needReset) {
+        resetNet();
+    }
+    initNet();
+    ThreadPinning pinning(affinityCpus);
+
+    auto boxes = detectRegion(cv::Rect(cv::Point(0, 0), srcSize), probeSide, 0.3f, 0.5f, 1.6f);
+    if(needBreak) {
+        needBreak = false;
+        return false;
+    }
+
+    double textArea = 0;
+    for(auto &box : boxes) {
+        textArea += boxBoundingRect(box).area();
+    }
+    coverage = static_cast<float>(std::min(1.0, textArea / static_cast<double>(srcSize.area())));
+
+    return !boxes.empty();
 }
 
 bool PaddleOCRApp::breakAnalyze()
@@ -640,16 +2339,137 @@ std::vector<DeepinOCRPlugin::TextBox> PaddleOCRApp::getCharBoxes(size_t index)
 {
     if (index >= charBoxes.size()) {
         return std::vector<DeepinOCRPlugin::TextBox>();
-    } else {
-        return charBoxes[index];
     }
+
+    //由文本框和CTC解码得到的字符长度计算字符位置，计算后缓存
+    //快照可能正在其他线程中由当前结果生成，写入缓存时需要持有snapshotMutex
+    if (!charBoxesBuilt[index]) {
+        std::lock_guard<std::mutex> locker(snapshotMutex);
+        auto &box = textBoxes[index];
+        charBoxes[index] = lengthToBox(charLengths[index], box.points[0], box.points[2].second - box.points[0].second, charRatios[index]);
+        charBoxesBuilt[index] = true;
+    }
+
+    return charBoxes[index];
 }
 
 std::string PaddleOCRApp::getAllResult()
 {
+    if (!allResultBuilt) {
+        allResult.clear();
+        for(const auto &eachResult : boxesResult) {
+            allResult += eachResult;
+            allResult += "\n";
+        }
+        allResultBuilt = true;
+    }
+
     return allResult;
 }
 
+void PaddleOCRApp::clearResults()
+{
+    textBoxes.clear();
+    boxesResult.clear();
+    charLengths.clear();
+    charRatios.clear();
+    charBoxes.clear();
+    charBoxesBuilt.clear();
+    allResult.clear();
+    allResultBuilt = false;
+    lineChanged.clear();
+}
+
+//由结果生成扁平化的快照，字符位置直接由字符长度写入连续的数组，不经过TextBox
+static std::shared_ptr<const DeepinOCRPlugin::ResultBuffer> buildSnapshot(const std::vector<DeepinOCRPlugin::TextBox> &textBoxes,
+                                                                          const std::vector<std::string> &boxesResult,
+                                                                          const std::vector<std::vector<int>> &charLengths,
+                                                                          const std::vector<float> &charRatios,
+                                                                          const std::vector<std::vector<DeepinOCRPlugin::TextBox>> &charBoxes,
+                                                                          const std::vector<bool> &charBoxesBuilt)
+{
+    auto buffer = std::make_shared<DeepinOCRPlugin::ResultBuffer>();
+    buffer->clear();
+    for(size_t i = 0; i != textBoxes.size(); ++i) {
+        if(charBoxesBuilt[i]) {
+            for(auto &charBox : charBoxes[i]) {
+                DeepinOCRPlugin::ResultBuffer::appendQuad(buffer->charQuads, charBox);
+            }
+        } else {
+            auto &box = textBoxes[i];
+            float left = box.points[0].first;
+            float top = box.points[0].second;
+            float bottom = box.points[2].second;
+            for(auto &eachLen : charLengths[i]) {
+                float right = left + eachLen * 4 / charRatios[i];
+                buffer->charQuads.insert(buffer->charQuads.end(), {left, top, right, top, right, bottom, left, bottom});
+                left = right;
+            }
+        }
+        buffer->appendLine(textBoxes[i], boxesResult[i]);
+    }
+    return buffer;
+}
+
+void PaddleOCRApp::markSnapshotPending()
+{
+    //旧快照由持有方继续使用，新的快照等到第一次获取时再生成
+    std::lock_guard<std::mutex> locker(snapshotMutex);
+    snapshot.reset();
+    snapshotSource.reset();
+    snapshotPending = true;
+}
+
+void PaddleOCRApp::detachSnapshotSource()
+{
+    //上一次的结果还没有生成快照时，整体移交而不是生成，analyze期间仍然可以从其他线程获取
+    std::lock_guard<std::mutex> locker(snapshotMutex);
+    if(!snapshotPending || snapshotSource != nullptr) {
+        return;
+    }
+
+    snapshotSource.reset(new SnapshotSource);
+    snapshotSource->textBoxes = std::move(textBoxes);
+    snapshotSource->boxesResult = std::move(boxesResult);
+    snapshotSource->charLengths = std::move(charLengths);
+    snapshotSource->charRatios = std::move(charRatios);
+    snapshotSource->charBoxes = std::move(charBoxes);
+    snapshotSource->charBoxesBuilt = std::move(charBoxesBuilt);
+    clearResults();
+}
+
+std::shared_ptr<const DeepinOCRPlugin::ResultBuffer> PaddleOCRApp::currentSnapshot()
+{
+    std::lock_guard<std::mutex> locker(snapshotMutex);
+    if(snapshotPending) {
+        if(snapshotSource != nullptr) {
+            snapshot = buildSnapshot(snapshotSource->textBoxes, snapshotSource->boxesResult, snapshotSource->charLengths,
+                                     snapshotSource->charRatios, snapshotSource->charBoxes, snapshotSource->charBoxesBuilt);
+            snapshotSource.reset();
+        } else {
+            snapshot = buildSnapshot(textBoxes, boxesResult, charLengths, charRatios, charBoxes, charBoxesBuilt);
+        }
+        snapshotPending = false;
+    }
+    return snapshot;
+}
+
+bool PaddleOCRApp::getResultView(DeepinOCRPlugin::ResultView &view)
+{
+    auto current = currentSnapshot();
+    if(current == nullptr) {
+        return false;
+    }
+
+    view = current->view();
+    return true;
+}
+
+std::shared_ptr<const DeepinOCRPlugin::ResultBuffer> PaddleOCRApp::getResultSnapshot()
+{
+    return currentSnapshot();
+}
+
 std::string PaddleOCRApp::getResultFromBox(size_t index)
 {
     return boxesResult[index];
@@ -25,20 +25,42 @@
 #include <deepinocrplugindef.h>
 #include <postprocess_op.h>
 #include <utility.h>
+#include <imagedecoder.h>
+#include <imagepyramid.h>
+#include <reccache.h>
+#include <resultcache.h>
+#include <ocrmodels.h>
+#include <autotune.h>
 
 #include <opencv2/opencv.hpp>
 
 #include <utility>
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
 
-namespace ncnn {
-    class Net;
-}
+//analyze的执行模式，与setValue中analyzeMode的取值一一对应
+enum class AnalyzeMode {
+    Full,      //检测并识别
+    Detect,    //只检测
+    Recognize, //只识别setRecognizeBoxes给出的区域
+    Auto       //检测并识别，单行图片跳过检测
+};
+
+//CPU使用配置，与setValue中cpuProfile的取值一一对应
+enum class CpuProfile {
+    Latency,   //绑定到大核，优先降低延迟
+    Balanced,  //不绑定，由系统调度
+    Efficiency //绑定到小核，减少线程数并降低检测分辨率，适用于后台任务
+};
 
 class PaddleOCRApp : public DeepinOCRPlugin::Plugin
 {
 public:
     PaddleOCRApp();
+    PaddleOCRApp(std::shared_ptr<SharedModels> models, const std::string &modelDir); //创建共享模型的会话
     ~PaddleOCRApp() override;
 
     bool setUseHardware(const std::vector<std::pair<DeepinOCRPlugin::HardwareID, int> > &hardwareUsed) override;
@@ -46,46 +68,174 @@ public:
     bool setUseMaxThreadsCount(unsigned int n) override;
     std::vector<std::string> getImageFileSupportFormats() override;
     bool setImageFile(const std::string &filePath) override;
+    bool setImageData(const unsigned char *data, size_t size) override;
     DeepinOCRPlugin::PixelType getPixelType() override;
     bool setMatrix(int height, int width, unsigned char *data, size_t step) override;
+    bool setMatrixBorrowed(int height, int width, unsigned char *data, size_t step, std::shared_ptr<void> holder) override;
+    std::vector<DeepinOCRPlugin::PixelType> getPixelTypeSupportList() override;
+    bool setMatrixBorrowed(int height, int width, unsigned char *data, size_t step, DeepinOCRPlugin::PixelType type, std::shared_ptr<void> holder) override;
     std::vector<std::string> getLanguageSupport() override;
     bool setLanguage(const std::string &language) override;
+    bool setValue(const std::string &key, const std::string &value) override;
+    std::string getValue(const std::string &key) override;
     bool analyze() override;
     bool breakAnalyze() override;
     std::vector<DeepinOCRPlugin::TextBox> getTextBoxes() override;
     std::vector<DeepinOCRPlugin::TextBox> getCharBoxes(size_t index) override;
     std::string getAllResult() override;
     std::string getResultFromBox(size_t index) override;
+    bool probeText(float &coverage) override;
+    bool setRecognizeBoxes(const std::vector<DeepinOCRPlugin::TextBox> &boxes) override;
+    bool setRegionsOfInterest(const std::vector<DeepinOCRPlugin::ImageRect> &regions) override;
+    bool getResultView(DeepinOCRPlugin::ResultView &view) override;
+    std::shared_ptr<const DeepinOCRPlugin::ResultBuffer> getResultSnapshot() override;
+    bool setAnalyzeCallbacks(const DeepinOCRPlugin::AnalyzeCallbacks &analyzeCallbacks) override;
+    std::shared_ptr<DeepinOCRPlugin::Plugin> createSession() override;
 
 private:
     //推理过程控制
     std::string currentPath;
     std::atomic_bool needReset = false;
     std::atomic_bool needBreak = false;
-    ncnn::Net *detNet = nullptr;
-    ncnn::Net *recNet = nullptr;
-    std::vector<std::string> keys;
+    int analyzeBudgetMs = 0;     //analyze的时间预算，为0时不限制
+    bool hasDeadline = false;    //当前analyze是否有时间预算
+    std::chrono::steady_clock::time_point deadline;
+    bool resultPartial = false;  //最近一次analyze是否因终止或超时只输出了部分结果
+    bool stopRequested();        //是否需要停止推理，超时时会设置needBreak
+    float remainingMs() const;   //距离时间预算截止还剩的毫秒数
+    std::atomic_bool resultDegraded = false;  //当前analyze是否用了分块检测或分段识别，这样的结果不写入缓存
+    std::atomic<float> detMsPerPixel = 0.0f;  //检测网络每个输入像素的耗时，用于判断是否需要分块检测
+    std::atomic<float> recMsPerColumn = 0.0f; //识别网络每列输入的耗时，用于判断是否需要分段识别
+    std::shared_ptr<SharedModels> sharedModels;  //与各个会话共享的模型
+    std::shared_ptr<const OCRModels> models;      //当前使用的模型，analyze期间一直持有
     PaddleOCR::PostProcessor postProcessor;
     PaddleOCR::Utility utilityTool;
     void resetNet(); //重置网络
     void initNet();  //初始化网络
-    std::vector<std::vector<std::vector<int>>> detect(const cv::Mat &src, float thresh, float boxThresh, float unclipRatio);   //检测
+    void updateThreads(); //根据设置和当前可用的CPU计算检测和识别的线程数
+    void autotune();      //获取进程内共享的自动调优结果
+    std::vector<int> profileCpus() const; //按cpuMask和cpuProfile选择推理线程绑定的CPU
+    int detectSide() const; //当前配置下检测时长边的最大尺寸
+    std::vector<std::vector<std::vector<int>>> detect(float thresh, float boxThresh, float unclipRatio);   //检测
+    bool incrementalEnabled() const; //当前设置下是否使用增量模式
+    bool lastFrameMatches() const;   //当前图像能否与上一帧比较
+    std::vector<uint64_t> computeTileHashes(); //计算图像各分块的哈希
+    std::vector<std::vector<std::vector<int>>> detectChanged(const std::vector<uint64_t> &tileHashes, std::vector<int> &reuseLines,
+                                                           float thresh, float boxThresh, float unclipRatio); //只检测与上一帧相比变化的区域，reuseLines为复用的上一帧文本行编号
+    std::vector<std::vector<std::vector<int>>> detectArea(const cv::Rect &area, float thresh, float boxThresh, float unclipRatio); //在一个区域内按当前的检测模式检测
+    std::vector<std::vector<std::vector<int>>> detectRegion(const cv::Rect &region, int maxSide, float thresh, float boxThresh, float unclipRatio); //检测图像中的一个区域，长边最多缩放到maxSide，剩余的时间预算不够时分块检测
+    std::vector<std::vector<std::vector<int>>> detectRegionOnce(const cv::Rect &region, int maxSide, float thresh, float boxThresh, float unclipRatio); //用一次推理检测图像中的一个区域
+    cv::Mat cropLine(const std::vector<std::vector<int>> &box, float &scale); //按文本框裁切出BGR格式的文本行，scale为所用金字塔层相对原图的比例
+    void setImage(const cv::Mat &image, DeepinOCRPlugin::PixelType type, std::shared_ptr<void> holder, bool borrowed, cv::Point2f scale = cv::Point2f(1.0f, 1.0f)); //设置待识别图像
+    void setDecodedImage(const DecodedImage &image); //使用解码结果作为待识别图像
+    bool ensureImage(); //命中磁盘缓存时图片文件延迟解码，需要图像数据时调用
+    uint64_t resultKey(); //当前图片文件和设置对应的磁盘缓存的键
     std::pair<std::string, std::vector<int>> ctcDecode(const std::vector<float> &recNetOutputData, int h, int w); //CTC解码
-    void rec(const std::vector<cv::Mat> &detectImg); //识别
+    std::vector<float> recInfer(const cv::Mat &stdMat, size_t index, int &steps, int &classes); //识别网络对一个已标准化为32像素高的文本行的推理，输出steps个时间步、每步classes个字符的概率
+    std::pair<std::string, std::vector<int>> recLine(const cv::Mat &stdMat, size_t index); //识别一个已标准化为32像素高的文本行
+    std::pair<std::string, std::vector<int>> recLineChunked(const cv::Mat &stdMat, size_t index); //分段识别较长的文本行
+    void rec(const std::vector<cv::Mat> &detectImg, const std::vector<float> &cropScales); //识别
+    bool isSingleLineImage() const; //是否为单行文本图片
+    std::vector<std::vector<int>> wholeImageBox() const; //整张图片的文本框
+    std::vector<std::vector<std::vector<int>>> callerBoxes() const; //只识别模式下待识别的文本框
     std::vector<DeepinOCRPlugin::TextBox> lengthToBox(const std::vector<int> &lengths, std::pair<float, float> basePoint, float rectHeight, float ratio);
 
     //推理设置缓存
-    cv::Mat imageCache;
+    ImagePyramid imagePyramid;         //待识别图像的金字塔，第0层为图像本身，其余层按需构建
+    std::shared_ptr<void> imageHolder; //图像数据引用外部内存时的数据持有者
+    bool imageBorrowed = false;        //图像数据是否为借用模式，借用模式下analyze返回时需要释放
+    cv::Point2f imageScale = cv::Point2f(1.0f, 1.0f); //图像相对原图的比例，宽高分别计算，按比例解码时小于1
+    DecodedImage imageSource;          //按比例解码的图片的编码数据，不含图像
+    cv::Mat fullRegion;                //从imageSource按原分辨率局部解码的BGR图像，识别高度不足的文本行时使用
+    cv::Rect fullRegionRect;           //fullRegion在原图上的范围
+    void prepareFullResolution(const std::vector<std::vector<std::vector<int>>> &boxes); //为需要原分辨率裁切的文本行局部解码
+    ImageDecoder imageDecoder;
     std::vector<std::string> supportLanguages = {"zh-Hans_en", "zh-Hant_en", "en"};
     std::vector<DeepinOCRPlugin::HardwareID> supportHardwares = {DeepinOCRPlugin::HardwareID::CPU_Any,
                                                                  DeepinOCRPlugin::HardwareID::GPU_Vulkan};
     std::vector<std::pair<DeepinOCRPlugin::HardwareID, int>> hardwareUseInfos;
     std::string languageUsed = "zh-Hans_en";
-    unsigned int maxThreadsUsed = 1;
+    unsigned int maxThreadsUsed = 1;  //调用方要求的线程数，为0时按可用的CPU自动选择
+    bool loadAwareThreads = false;    //自动选择线程数时是否考虑系统负载
+    unsigned int availableCpus = 1;   //最近一次计算的可用CPU数
+    unsigned int detThreadsUsed = 1;  //检测网络实际使用的线程数
+    unsigned int recThreadsUsed = 1;  //识别时实际使用的线程数
+    unsigned int detThreadsGranted = 1; //最近一次检测从线程预算中分到的线程数
+    unsigned int recThreadsGranted = 1; //最近一次识别从线程预算中分到的线程数
+    CpuProfile cpuProfile = CpuProfile::Balanced;
+    std::vector<std::string> cpuProfileNames = {"latency", "balanced", "efficiency"};
+    std::vector<int> cpuMask;         //显式指定推理使用的CPU，为空时由cpuProfile决定
+    std::vector<int> affinityCpus;    //最近一次计算的推理线程绑定的CPU，为空时不绑定
+    bool autotuneEnabled = false;     //是否使用自动调优的网络选项和线程数
+    bool autotunePending = false;     //下一次初始化时需要获取调优结果
+    TuneResult tuneResult;            //自动调优的结果
+    bool adaptiveDetect = false;  //自适应检测：先低分辨率检测，再对小字区域做高分辨率检测
+    int detectMaxSide = 960;      //检测时长边的最大尺寸
+    int detectCoarseSide = 480;   //自适应检测时低分辨率检测的长边尺寸
+    int probeSide = 320;          //文本探测时检测的长边尺寸
+    AnalyzeMode analyzeMode = AnalyzeMode::Full;
+    std::vector<std::string> analyzeModeNames = {"full", "detect", "recognize", "auto"};
+    std::vector<DeepinOCRPlugin::TextBox> recognizeBoxes; //只识别模式下调用方给出的文本框
+    std::vector<DeepinOCRPlugin::ImageRect> regionsOfInterest; //感兴趣区域，为空时检测整张图
+    RecCache recCache;            //识别结果缓存
+    std::shared_ptr<ResultCache> resultCache = std::make_shared<ResultCache>(); //磁盘上的整图识别结果缓存，与各个会话共享
+    uint64_t imageFileKey = 0;    //图像来自文件时文件的标识，否则为0
+    uint64_t modelKey = 0;        //模型文件的标识
+    std::string modelKeyLanguage; //modelKey对应的语种
+    std::string deferredFilePath; //命中磁盘缓存而未解码的图片文件
+    CachedResult cachedResult;    //最近一次读取或写入的磁盘缓存
+    uint64_t cachedResultKey = 0; //cachedResult对应的键
+    bool incrementalMode = false; //增量模式：连续帧中只重新处理变化的区域
+
+    //增量模式下上一帧的数据，坐标为换算回原图之前的坐标
+    struct FrameRecord {
+        cv::Size size;
+        DeepinOCRPlugin::PixelType type = DeepinOCRPlugin::PixelType::Pixel_Unknown;
+        cv::Point2f scale = cv::Point2f(1.0f, 1.0f);
+        std::vector<uint64_t> tileHashes; //为空时表示没有可用的上一帧
+        std::vector<DeepinOCRPlugin::TextBox> textBoxes;
+        std::vector<std::string> boxesResult;
+        std::vector<std::vector<int>> charLengths;
+        std::vector<float> charRatios;
+    } lastFrame;
 
     //推理结果缓存
+    void clearResults(); //清空推理结果
     std::vector<DeepinOCRPlugin::TextBox> textBoxes;
-    std::vector<std::vector<DeepinOCRPlugin::TextBox>> charBoxes;
-    std::string allResult;
     std::vector<std::string> boxesResult;
+    std::vector<std::vector<int>> charLengths; //各文本行中每个字符在CTC输出中的长度
+    std::vector<float> charRatios;             //各文本行的字符长度换算为坐标时的比例
+    std::vector<std::vector<DeepinOCRPlugin::TextBox>> charBoxes; //按需生成的字符位置
+    std::vector<bool> charBoxesBuilt;
+    std::string allResult;                     //按需生成的总体识别结果
+    bool allResultBuilt = false;
+    //逐行回调
+    void emitBoxes(cv::Point2f scale); //输出检测结果，scale为当前坐标相对原图的比例
+    void beginLineEmission();     //开始记录文本行的完成情况，已有结果的文本行视为已完成
+    void lineFinished(size_t index); //第index行识别完成，线程安全
+    void flushFinishedLines();    //按顺序输出已完成的文本行，调用前需要持有emitMutex
+    DeepinOCRPlugin::AnalyzeCallbacks callbacks;
+    std::mutex emitMutex;
+    std::vector<char> lineDone;   //各文本行是否已完成
+    size_t nextEmitLine = 0;      //下一个需要输出的文本行
+    cv::Point2f emitScale = cv::Point2f(1.0f, 1.0f);
+
+    //结果快照在analyze完成后第一次获取时才生成，不使用快照时没有额外开销
+    //生成前其他线程可能读取结果，因此snapshotPending期间对结果的修改需要持有snapshotMutex
+    struct SnapshotSource {
+        std::vector<DeepinOCRPlugin::TextBox> textBoxes;
+        std::vector<std::string> boxesResult;
+        std::vector<std::vector<int>> charLengths;
+        std::vector<float> charRatios;
+        std::vector<std::vector<DeepinOCRPlugin::TextBox>> charBoxes;
+        std::vector<bool> charBoxesBuilt;
+    };
+    void markSnapshotPending();   //analyze完成，当前结果需要在获取时生成新的快照
+    void detachSnapshotSource();  //analyze修改结果前调用，尚未生成快照的结果移交给snapshotSource
+    std::shared_ptr<const DeepinOCRPlugin::ResultBuffer> currentSnapshot(); //获取快照，需要时生成
+    std::mutex snapshotMutex;
+    bool snapshotPending = false; //最近一次analyze的结果尚未生成快照
+    std::unique_ptr<SnapshotSource> snapshotSource; //analyze开始后移交的上一次结果，为空时使用当前结果
+    std::shared_ptr<const DeepinOCRPlugin::ResultBuffer> snapshot; //最近一次analyze的结果快照
+    std::vector<bool> lineChanged; //各文本行是否为本次新识别的结果
 };
@@ -338,9 +338,13 @@ std::vector<std::vector<std::vector<int>>>
 PostProcessor::FilterTagDetRes(std::vector<std::vector<std::vector<int>>> boxes,
                                float ratio_h, float ratio_w, cv::Mat srcimg)
 {
-    int oriimg_h = srcimg.rows;
-    int oriimg_w = srcimg.cols;
+    return FilterTagDetRes(boxes, ratio_h, ratio_w, srcimg.cols, srcimg.rows);
+}
 
+std::vector<std::vector<std::vector<int>>>
+PostProcessor::FilterTagDetRes(std::vector<std::vector<std::vector<int>>> boxes,
+                               float ratio_h, float ratio_w, int oriimg_w, int oriimg_h)
+{
     std::vector<std::vector<std::vector<int>>> root_points;
     for (int n = 0; n < boxes.size(); n++) {
         boxes[n] = OrderPointsClockwise(boxes[n]);
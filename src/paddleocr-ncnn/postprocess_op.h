@@ -62,6 +62,10 @@ public:
   FilterTagDetRes(std::vector<std::vector<std::vector<int>>> boxes,
                   float ratio_h, float ratio_w, cv::Mat srcimg);
 
+  std::vector<std::vector<std::vector<int>>>
+  FilterTagDetRes(std::vector<std::vector<std::vector<int>>> boxes,
+                  float ratio_h, float ratio_w, int oriimg_w, int oriimg_h);
+
 private:
   static bool XsortInt(std::vector<int> a, std::vector<int> b);
 
@@ -0,0 +1,118 @@
+/*
+* Copyright (C) 2020 ~ 2022 Deepin Technology Co., Ltd.
+*
+* Author: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* Maintainer: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "reccache.h"
+
+//每个缓存项除文本和长度数据外的固定开销的估计值（链表节点、哈希表节点）
+static constexpr size_t EntryOverhead = 96;
+
+uint64_t RecCache::hashInput(const cv::Mat &input)
+{
+    uint64_t hash = hashBytes(reinterpret_cast<const unsigned char *>(&input.rows), sizeof(input.rows));
+    hash = hashBytes(reinterpret_cast<const unsigned char *>(&input.cols), sizeof(input.cols), hash);
+
+    size_t rowBytes = static_cast<size_t>(input.cols) * input.elemSize();
+    for(int y = 0; y < input.rows; ++y) {
+        hash = hashBytes(input.ptr(y), rowBytes, hash);
+    }
+    return hash;
+}
+
+bool RecCache::find(uint64_t key, std::string &text, std::vector<int> &lengths)
+{
+    std::lock_guard<std::mutex> locker(mutex);
+
+    auto iter = index.find(key);
+    if(iter == index.end()) {
+        ++missCount;
+        return false;
+    }
+
+    //移动到头部，标记为最近使用
+    entries.splice(entries.begin(), entries, iter->second);
+    text = iter->second->text;
+    lengths = iter->second->lengths;
+    ++hitCount;
+    return true;
+}
+
+void RecCache::insert(uint64_t key, const std::string &text, const std::vector<int> &lengths)
+{
+    std::lock_guard<std::mutex> locker(mutex);
+
+    size_t bytes = EntryOverhead + text.size() + lengths.size() * sizeof(int);
+    if(bytes > maxBytes || index.find(key) != index.end()) {
+        return;
+    }
+
+    entries.push_front(Entry{key, text, lengths, bytes});
+    index[key] = entries.begin();
+    usedBytes += bytes;
+    evict();
+}
+
+void RecCache::clear()
+{
+    std::lock_guard<std::mutex> locker(mutex);
+
+    entries.clear();
+    index.clear();
+    usedBytes = 0;
+}
+
+void RecCache::setCapacity(size_t bytes)
+{
+    std::lock_guard<std::mutex> locker(mutex);
+
+    maxBytes = bytes;
+    evict();
+}
+
+size_t RecCache::capacity() const
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    return maxBytes;
+}
+
+size_t RecCache::usage() const
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    return usedBytes;
+}
+
+uint64_t RecCache::hits() const
+{
+    return hitCount;
+}
+
+uint64_t RecCache::misses() const
+{
+    return missCount;
+}
+
+void RecCache::evict()
+{
+    while(usedBytes > maxBytes && !entries.empty()) {
+        usedBytes -= entries.back().bytes;
+        index.erase(entries.back().key);
+        entries.pop_back();
+    }
+}
@@ -0,0 +1,98 @@
+/*
+* Copyright (C) 2020 ~ 2022 Deepin Technology Co., Ltd.
+*
+* Author: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* Maintainer: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//按8字节分组计算的FNV-1a哈希，hash为上一段数据的哈希值，用于分段累计
+//插件动态库与其他插件加载在同一进程中，内部函数不导出符号
+static inline uint64_t hashBytes(const unsigned char *data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL)
+{
+    const uint64_t prime = 0x100000001b3ULL;
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(uint64_t));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 32;
+    }
+    for(; i < size; ++i) {
+        hash = (hash ^ data[i]) * prime;
+    }
+    return hash;
+}
+
+//识别结果缓存，以识别网络输入图像（高度固定为32的文本行）的哈希为键，按LRU淘汰
+//界面截图中大量重复的菜单、按钮文字可以直接命中缓存，跳过识别网络的推理
+class RecCache
+{
+public:
+    //计算识别网络输入图像的哈希，尺寸也参与计算
+    static uint64_t hashInput(const cv::Mat &input);
+
+    //查找缓存，命中时输出文本和各字符的相对长度，线程安全
+    bool find(uint64_t key, std::string &text, std::vector<int> &lengths);
+
+    //插入缓存，超出内存上限时淘汰最久未使用的项，线程安全
+    void insert(uint64_t key, const std::string &text, const std::vector<int> &lengths);
+
+    //清空缓存，命中统计保留
+    void clear();
+
+    //内存上限，单位为字节，为0时不使用缓存
+    void setCapacity(size_t bytes);
+    size_t capacity() const;
+
+    //当前占用的内存
+    size_t usage() const;
+
+    //命中和未命中的次数
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+private:
+    struct Entry {
+        uint64_t key;
+        std::string text;
+        std::vector<int> lengths;
+        size_t bytes;
+    };
+
+    void evict(); //淘汰到内存上限以内，调用前需要持有锁
+
+    mutable std::mutex mutex;
+    std::list<Entry> entries; //头部为最近使用的项
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+    size_t maxBytes = 4 * 1024 * 1024;
+    size_t usedBytes = 0;
+    std::atomic<uint64_t> hitCount{0};
+    std::atomic<uint64_t> missCount{0};
+};
@@ -0,0 +1,400 @@
+/*
+* Copyright (C) 2020 ~ 2022 Deepin Technology Co., Ltd.
+*
+* Author: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* Maintainer: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "resultcache.h"
+#include "reccache.h"
+
+#include <toolkits.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//文件格式版本，格式变化时需要修改，旧文件会被视为未命中
+static constexpr uint32_t RecordVersion = 1;
+
+//计算文件标识时读取的首尾数据长度
+static constexpr size_t IdentitySampleSize = 64 * 1024;
+
+struct RecordHeader {
+    char magic[4];        //固定为DOCR
+    uint32_t version;
+    uint64_t key;
+    uint32_t lineCount;
+    uint32_t charCount;
+    uint32_t textBytes;
+    uint32_t reserved;
+};
+
+//文本框：4个点的坐标和倾斜角
+struct BoxRecord {
+    float points[8];
+    float angle;
+};
+
+struct LineRecord {
+    BoxRecord box;
+    uint32_t textOffset;
+    uint32_t textLength;
+    uint32_t charOffset;
+    uint32_t charCount;
+};
+
+static bool toBoxRecord(const DeepinOCRPlugin::TextBox &box, BoxRecord &record)
+{
+    if(box.points.size() != 4) {
+        return false;
+    }
+
+    for(size_t i = 0; i != 4; ++i) {
+        record.points[i * 2] = box.points[i].first;
+        record.points[i * 2 + 1] = box.points[i].second;
+    }
+    record.angle = box.angle;
+    return true;
+}
+
+static DeepinOCRPlugin::TextBox fromBoxRecord(const BoxRecord &record)
+{
+    DeepinOCRPlugin::TextBox box;
+    for(size_t i = 0; i != 4; ++i) {
+        box.points.push_back(std::make_pair(record.points[i * 2], record.points[i * 2 + 1]));
+    }
+    box.angle = record.angle;
+    return box;
+}
+
+uint64_t ResultCache::fileIdentity(const std::string &filePath)
+{
+    int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return 0;
+    }
+
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) {
+        close(fd);
+        return 0;
+    }
+
+    uint64_t hash = hashBytes(reinterpret_cast<const unsigned char *>(filePath.data()), filePath.size());
+    int64_t identity[5] = {static_cast<int64_t>(fileStat.st_size), static_cast<int64_t>(fileStat.st_mtim.tv_sec),
+                           static_cast<int64_t>(fileStat.st_mtim.tv_nsec), static_cast<int64_t>(fileStat.st_ino),
+                           static_cast<int64_t>(fileStat.st_dev)};
+    hash = hashBytes(reinterpret_cast<const unsigned char *>(identity), sizeof(identity), hash);
+
+    //首尾各取一段内容参与计算，防止修改时间被保留的情况下内容已变化
+    std::vector<unsigned char> buffer(IdentitySampleSize);
+    size_t fileSize = static_cast<size_t>(fileStat.st_size);
+    ssize_t headSize = pread(fd, buffer.data(), std::min(fileSize, IdentitySampleSize), 0);
+    if(headSize > 0) {
+        hash = hashBytes(buffer.data(), static_cast<size_t>(headSize), hash);
+    }
+    if(fileSize > IdentitySampleSize) {
+        off_t tailOffset = static_cast<off_t>(std::max(fileSize - IdentitySampleSize, IdentitySampleSize));
+        ssize_t tailSize = pread(fd, buffer.data(), fileSize - static_cast<size_t>(tailOffset), tailOffset);
+        if(tailSize > 0) {
+            hash = hashBytes(buffer.data(), static_cast<size_t>(tailSize), hash);
+        }
+    }
+
+    close(fd);
+
+    //0作为失败的返回值
+    return hash == 0 ? 1 : hash;
+}
+
+void ResultCache::setEnabled(bool enabled)
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    isEnabled = enabled;
+}
+
+bool ResultCache::enabled() const
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    return isEnabled;
+}
+
+void ResultCache::setDirectory(const std::string &dir)
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    cacheDir = dir;
+    usedBytes = -1;
+}
+
+std::string ResultCache::directory() const
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    return directoryLocked();
+}
+
+std::string ResultCache::directoryLocked() const
+{
+    if(!cacheDir.empty()) {
+        return cacheDir;
+    }
+
+    std::string userCacheDir = getUserCacheDir();
+    return userCacheDir.empty() ? "" : userCacheDir + "/paddleocr-ncnn";
+}
+
+void ResultCache::setCapacity(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    maxBytes = bytes;
+    if(usedBytes > static_cast<int64_t>(maxBytes)) {
+        evictLocked();
+    }
+}
+
+uint64_t ResultCache::capacity() const
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    return maxBytes;
+}
+
+static std::string recordPath(const std::string &dir, uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.ocr", static_cast<unsigned long long>(key));
+    return dir + name;
+}
+
+bool ResultCache::load(uint64_t key, CachedResult &result)
+{
+    std::string dir;
+    {
+        std::lock_guard<std::mutex> locker(mutex);
+        if(!isEnabled) {
+            return false;
+        }
+        dir = directoryLocked();
+    }
+    if(dir.empty()) {
+        return false;
+    }
+
+    std::string path = recordPath(dir, key);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return false;
+    }
+
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0 || static_cast<size_t>(fileStat.st_size) < sizeof(RecordHeader)) {
+        close(fd);
+        return false;
+    }
+
+    size_t fileSize = static_cast<size_t>(fileStat.st_size);
+    void *mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(mapped == MAP_FAILED) {
+        return false;
+    }
+
+    bool valid = false;
+    do {
+        auto data = static_cast<const unsigned char *>(mapped);
+        RecordHeader header;
+        memcpy(&header, data, sizeof(header));
+        if(memcmp(header.magic, "DOCR", 4) != 0 || header.version != RecordVersion || header.key != key) {
+            break;
+        }
+
+        size_t linesOffset = sizeof(RecordHeader);
+        size_t charsOffset = linesOffset + header.lineCount * sizeof(LineRecord);
+        size_t textOffset = charsOffset + header.charCount * sizeof(BoxRecord);
+        if(textOffset + header.textBytes != fileSize) {
+            break;
+        }
+
+        std::vector<LineRecord> lines(header.lineCount);
+        memcpy(lines.data(), data + linesOffset, lines.size() * sizeof(LineRecord));
+        std::vector<BoxRecord> chars(header.charCount);
+        memcpy(chars.data(), data + charsOffset, chars.size() * sizeof(BoxRecord));
+        const char *text = reinterpret_cast<const char *>(data + textOffset);
+
+        result = CachedResult();
+        valid = true;
+        for(auto &line : lines) {
+            if(static_cast<uint64_t>(line.textOffset) + line.textLength > header.textBytes
+                    || static_cast<uint64_t>(line.charOffset) + line.charCount > header.charCount) {
+                valid = false;
+                break;
+            }
+
+            result.textBoxes.push_back(fromBoxRecord(line.box));
+            result.boxesResult.emplace_back(text + line.textOffset, line.textLength);
+            std::vector<DeepinOCRPlugin::TextBox> charBoxes;
+            for(uint32_t i = 0; i != line.charCount; ++i) {
+                charBoxes.push_back(fromBoxRecord(chars[line.charOffset + i]));
+            }
+            result.charBoxes.push_back(std::move(charBoxes));
+        }
+    } while(0);
+
+    munmap(mapped, fileSize);
+
+    //更新修改时间，作为淘汰时的最近使用时间
+    if(valid) {
+        utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    }
+
+    return valid;
+}
+
+bool ResultCache::store(uint64_t key, const CachedResult &result)
+{
+    std::string dir;
+    {
+        std::lock_guard<std::mutex> locker(mutex);
+        if(!isEnabled) {
+            return false;
+        }
+        dir = directoryLocked();
+    }
+    if(dir.empty()) {
+        return false;
+    }
+
+    if(result.textBoxes.size() != result.boxesResult.size() || result.textBoxes.size() != result.charBoxes.size()) {
+        return false;
+    }
+
+    //组装文件内容
+    std::vector<LineRecord> lines;
+    std::vector<BoxRecord> chars;
+    std::string text;
+    for(size_t i = 0; i != result.textBoxes.size(); ++i) {
+        LineRecord line;
+        if(!toBoxRecord(result.textBoxes[i], line.box)) {
+            return false;
+        }
+        line.textOffset = static_cast<uint32_t>(text.size());
+        line.textLength = static_cast<uint32_t>(result.boxesResult[i].size());
+        line.charOffset = static_cast<uint32_t>(chars.size());
+        line.charCount = static_cast<uint32_t>(result.charBoxes[i].size());
+        text += result.boxesResult[i];
+        for(auto &charBox : result.charBoxes[i]) {
+            BoxRecord record;
+            if(!toBoxRecord(charBox, record)) {
+                return false;
+            }
+            chars.push_back(record);
+        }
+        lines.push_back(line);
+    }
+
+    RecordHeader header;
+    memcpy(header.magic, "DOCR", 4);
+    header.version = RecordVersion;
+    header.key = key;
+    header.lineCount = static_cast<uint32_t>(lines.size());
+    header.charCount = static_cast<uint32_t>(chars.size());
+    header.textBytes = static_cast<uint32_t>(text.size());
+    header.reserved = 0;
+
+    std::error_code error;
+    std::filesystem::create_directories(dir, error);
+
+    //临时文件名在进程间和进程内的各个写入者之间都唯一，同时写入同一个结果时不会相互覆盖
+    static std::atomic<uint64_t> tempSerial(0);
+    std::string path = recordPath(dir, key);
+    std::string tempPath = path + "." + std::to_string(getpid()) + "." + std::to_string(tempSerial++) + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if(!file) {
+            DEEPIN_LOG("cannot write result cache: %s", tempPath.c_str());
+            return false;
+        }
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(lines.data()), static_cast<std::streamsize>(lines.size() * sizeof(LineRecord)));
+        file.write(reinterpret_cast<const char *>(chars.data()), static_cast<std::streamsize>(chars.size() * sizeof(BoxRecord)));
+        file.write(text.data(), static_cast<std::streamsize>(text.size()));
+        if(!file) {
+            file.close();
+            std::filesystem::remove(tempPath, error);
+            return false;
+        }
+    }
+
+    if(rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::filesystem::remove(tempPath, error);
+        return false;
+    }
+
+    //第一次写入时统计一次目录大小，之后累加
+    std::lock_guard<std::mutex> locker(mutex);
+    if(usedBytes < 0) {
+        evictLocked();
+    } else {
+        usedBytes += static_cast<int64_t>(sizeof(header) + lines.size() * sizeof(LineRecord) + chars.size() * sizeof(BoxRecord) + text.size());
+        if(usedBytes > static_cast<int64_t>(maxBytes)) {
+            evictLocked();
+        }
+    }
+
+    return true;
+}
+
+void ResultCache::evictLocked()
+{
+    std::string dir = directoryLocked();
+    std::error_code error;
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+    int64_t total = 0;
+    for(auto &entry : std::filesystem::directory_iterator(dir, error)) {
+        if(entry.path().extension() != ".ocr") {
+            continue;
+        }
+        auto size = entry.file_size(error);
+        if(error) {
+            continue;
+        }
+        total += static_cast<int64_t>(size);
+        files.emplace_back(entry.last_write_time(error), entry.path());
+    }
+
+    if(total > static_cast<int64_t>(maxBytes)) {
+        std::sort(files.begin(), files.end());
+        int64_t target = static_cast<int64_t>(maxBytes / 10 * 9);
+        for(auto &file : files) {
+            if(total <= target) {
+                break;
+            }
+            auto size = std::filesystem::file_size(file.second, error);
+            if(!error && std::filesystem::remove(file.second, error)) {
+                total -= static_cast<int64_t>(size);
+            }
+        }
+    }
+
+    usedBytes = total;
+}
@@ -0,0 +1,75 @@
+/*
+* Copyright (C) 2020 ~ 2022 Deepin Technology Co., Ltd.
+*
+* Author: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* Maintainer: WangZhengYang<wangzhengyang@uniontech.com>
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <deepinocrplugindef.h>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//缓存的一张图片的识别结果，坐标基于原图
+struct CachedResult {
+    std::vector<DeepinOCRPlugin::TextBox> textBoxes;
+    std::vector<std::vector<DeepinOCRPlugin::TextBox>> charBoxes;
+    std::vector<std::string> boxesResult;
+};
+
+//磁盘上的识别结果缓存，每个结果一个文件，文件名为键的十六进制形式
+//文件由固定长度的头部和三段连续的数组组成，可以直接mmap后读取
+//总大小超过上限时按最近使用时间淘汰
+//同一插件的各个会话共享一个实例，各接口线程安全
+class ResultCache
+{
+public:
+    //计算图片文件的标识：路径、大小、修改时间、inode以及文件首尾各64KB内容的哈希，失败时返回0
+    //不对整个文件做哈希，避免大量图片时的读取开销
+    static uint64_t fileIdentity(const std::string &filePath);
+
+    void setEnabled(bool enabled);
+    bool enabled() const;
+
+    //缓存目录，默认为用户缓存目录下的paddleocr-ncnn
+    void setDirectory(const std::string &dir);
+    std::string directory() const;
+
+    //总大小上限，单位为字节
+    void setCapacity(uint64_t bytes);
+    uint64_t capacity() const;
+
+    //读取缓存
+    bool load(uint64_t key, CachedResult &result);
+
+    //写入缓存，先写入临时文件再重命名，保证其他进程不会读到写了一半的文件
+    bool store(uint64_t key, const CachedResult &result);
+
+private:
+    std::string directoryLocked() const;
+    void evictLocked(); //删除最久未使用的文件，直到总大小低于上限的90%，调用前需要持有mutex
+
+    mutable std::mutex mutex; //保护设置和大小统计
+    bool isEnabled = false;
+    std::string cacheDir;
+    uint64_t maxBytes = 256ULL * 1024 * 1024;
+    int64_t usedBytes = -1; //为-1时表示还没有统计过
+};
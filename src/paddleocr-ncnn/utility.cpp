@@ -98,8 +98,6 @@ void Utility::GetAllFiles(const char *dir_name,
 cv::Mat Utility::GetRotateCropImage(const cv::Mat &srcimage,
                                     std::vector<std::vector<int>> box)
 {
-    cv::Mat image;
-    srcimage.copyTo(image);
     std::vector<std::vector<int>> points = box;
 
     int x_collect[4] = {box[0][0], box[1][0], box[2][0], box[3][0]};
@@ -109,8 +107,9 @@ cv::Mat Utility::GetRotateCropImage(const cv::Mat &srcimage,
     int top = int(*std::min_element(y_collect, y_collect + 4));
     int bottom = int(*std::max_element(y_collect, y_collect + 4));
 
-    cv::Mat img_crop;
-    image(cv::Rect(left, top, right - left, bottom - top)).copyTo(img_crop);
+    // only the box region is read, so take a view instead of copying the
+    // whole source image for every crop
+    cv::Mat img_crop = srcimage(cv::Rect(left, top, right - left, bottom - top));
 
     for (int i = 0; i < points.size(); i++) {
         points[i][0] -= left;
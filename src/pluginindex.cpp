@@ -0,0 +1,188 @@
+#include "pluginindex.h"
+#include "toolkits.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+namespace DeepinOCRPlugin {
+
+//清单中硬件的名字与HardwareID的对应关系
+static const std::pair<const char *, HardwareID> HardwareNames[] = {
+    {"Network", HardwareID::Network},
+    {"CPU_Any", HardwareID::CPU_Any},
+    {"CPU_Intel", HardwareID::CPU_Intel},
+    {"CPU_AMD", HardwareID::CPU_AMD},
+    {"CPU_AArch64", HardwareID::CPU_AArch64},
+    {"CPU_MIPS", HardwareID::CPU_MIPS},
+    {"CPU_LoongArch", HardwareID::CPU_LoongArch},
+    {"CPU_SW", HardwareID::CPU_SW},
+    {"GPU_Any", HardwareID::GPU_Any},
+    {"GPU_Vulkan", HardwareID::GPU_Vulkan},
+    {"GPU_NVIDIA", HardwareID::GPU_NVIDIA},
+    {"GPU_AMD", HardwareID::GPU_AMD},
+    {"GPU_MT", HardwareID::GPU_MT},
+    {"GPU_JM", HardwareID::GPU_JM},
+    {"GPU_Loongson", HardwareID::GPU_Loongson},
+    {"GPU_Innosilicon", HardwareID::GPU_Innosilicon},
+    {"GPU_LM", HardwareID::GPU_LM},
+    {"GPU_BR", HardwareID::GPU_BR}
+};
+
+static bool sameTime(const timespec &left, const timespec &right)
+{
+    return left.tv_sec == right.tv_sec && left.tv_nsec == right.tv_nsec;
+}
+
+//拆分逗号分隔的列表，去掉各项首尾的空白
+static std::vector<std::string> splitList(const std::string &value)
+{
+    std::vector<std::string> result;
+    std::stringstream ss(value);
+    std::string item;
+    while(std::getline(ss, item, ',')) {
+        size_t begin = item.find_first_not_of(" \t");
+        size_t end = item.find_last_not_of(" \t\r");
+        if(begin != std::string::npos) {
+            result.push_back(item.substr(begin, end - begin + 1));
+        }
+    }
+    return result;
+}
+
+PluginIndex &PluginIndex::instance()
+{
+    static PluginIndex index;
+    return index;
+}
+
+bool PluginIndex::parseManifest(std::istream &stream, PluginManifest &result)
+{
+    PluginManifest parsed;
+    std::string line;
+    while(std::getline(stream, line)) {
+        if(line.empty() || line[0] == '#') {
+            continue;
+        }
+        size_t pos = line.find('=');
+        if(pos == std::string::npos) {
+            continue;
+        }
+
+        std::string key = line.substr(0, pos);
+        std::string value = line.substr(pos + 1);
+        if(key == "version") {
+            char *end = nullptr;
+            long version = std::strtol(value.c_str(), &end, 0);
+            if(end == value.c_str()) {
+                DEEPIN_LOG("invalid plugin manifest version: %s", value.c_str());
+                return false;
+            }
+            parsed.version = static_cast<int>(version);
+        } else if(key == "hardware") {
+            for(auto &name : splitList(value)) {
+                auto iter = std::find_if(std::begin(HardwareNames), std::end(HardwareNames), [&name](const std::pair<const char *, HardwareID> &item) {
+                    return name == item.first;
+                });
+                if(iter == std::end(HardwareNames)) {
+                    DEEPIN_LOG("unknown hardware in plugin manifest: %s", name.c_str());
+                    continue;
+                }
+                parsed.hardware.push_back(iter->second);
+            }
+        } else if(key == "languages") {
+            parsed.languages = splitList(value);
+        } else if(key == "formats") {
+            parsed.imageFormats = splitList(value);
+        }
+    }
+
+    result = std::move(parsed);
+    return true;
+}
+
+PluginIndex::DirIndex &PluginIndex::refresh(const std::string &installDir)
+{
+    //增删插件目录会改变安装目录的修改时间，此时重新扫描
+    auto &index = dirs[installDir];
+    struct stat info;
+    if(stat(installDir.c_str(), &info) != 0) {
+        index = DirIndex();
+        return index;
+    }
+    if(index.valid && sameTime(index.dirTime, info.st_mtim)) {
+        return index;
+    }
+
+    auto names = getSubDirNames(installDir);
+    std::sort(names.begin(), names.end());
+
+    //保留仍然存在的插件已读取的清单
+    std::vector<Entry> entries;
+    for(auto &name : names) {
+        auto iter = std::find_if(index.entries.begin(), index.entries.end(), [&name](const Entry &entry) {
+            return entry.name == name;
+        });
+        if(iter != index.entries.end()) {
+            entries.push_back(std::move(*iter));
+        } else {
+            Entry entry;
+            entry.name = name;
+            entries.push_back(std::move(entry));
+        }
+    }
+
+    index.entries = std::move(entries);
+    index.dirTime = info.st_mtim;
+    index.valid = true;
+    return index;
+}
+
+std::vector<std::string> PluginIndex::names(const std::string &installDir)
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    auto &index = refresh(installDir);
+
+    std::vector<std::string> result;
+    for(auto &entry : index.entries) {
+        result.push_back(entry.name);
+    }
+    return result;
+}
+
+bool PluginIndex::manifest(const std::string &installDir, const std::string &name, PluginManifest &result)
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    auto &index = refresh(installDir);
+    auto iter = std::find_if(index.entries.begin(), index.entries.end(), [&name](const Entry &entry) {
+        return entry.name == name;
+    });
+    if(iter == index.entries.end()) {
+        return false;
+    }
+
+    //清单文件被修改或删除后重新读取
+    std::string path = installDir + "/" + name + "/manifest.conf";
+    struct stat info;
+    if(stat(path.c_str(), &info) != 0) {
+        iter->manifestChecked = true;
+        iter->hasManifest = false;
+        return false;
+    }
+    if(!iter->manifestChecked || !sameTime(iter->manifestTime, info.st_mtim)) {
+        std::ifstream fs(path);
+        iter->manifestChecked = true;
+        iter->manifestTime = info.st_mtim;
+        iter->hasManifest = fs.is_open() && parseManifest(fs, iter->manifest);
+    }
+
+    if(iter->hasManifest) {
+        result = iter->manifest;
+    }
+    return iter->hasManifest;
+}
+
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "deepinocrplugindef.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <time.h>
+
+namespace DeepinOCRPlugin {
+
+//进程内的插件索引，记录插件安装目录下的插件名和各插件的清单
+//安装目录的修改时间不变时直接使用缓存的插件名，清单文件的修改时间不变时直接使用缓存的清单
+//枚举插件和查询清单都不需要加载插件
+class PluginIndex
+{
+public:
+    static PluginIndex &instance();
+
+    //安装目录下的全部插件名
+    std::vector<std::string> names(const std::string &installDir);
+
+    //读取插件的清单
+    //输出：插件存在并且有可以解析的清单时返回true
+    bool manifest(const std::string &installDir, const std::string &name, PluginManifest &result);
+
+    //解析清单内容，供manifest.conf以外的来源使用
+    static bool parseManifest(std::istream &stream, PluginManifest &result);
+
+private:
+    PluginIndex() = default;
+
+    struct Entry {
+        std::string name;
+        bool manifestChecked = false; //是否已读取过清单
+        bool hasManifest = false;
+        timespec manifestTime = {0, 0};
+        PluginManifest manifest;
+    };
+
+    struct DirIndex {
+        bool valid = false;
+        timespec dirTime = {0, 0};
+        std::vector<Entry> entries;
+    };
+
+    DirIndex &refresh(const std::string &installDir); //按需重建目录索引，调用前需要持有锁
+
+    std::mutex mutex;
+    std::map<std::string, DirIndex> dirs;
+};
+
+}
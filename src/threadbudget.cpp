@@ -0,0 +1,81 @@
+#include "threadbudget.h"
+#include "toolkits.h"
+
+#include <algorithm>
+
+namespace DeepinOCRPlugin {
+
+ThreadBudget &ThreadBudget::instance()
+{
+    static ThreadBudget budget;
+    return budget;
+}
+
+ThreadBudget::ThreadBudget()
+{
+    total = getAvailableCpuCount();
+}
+
+void ThreadBudget::setCapacity(unsigned int n)
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    total = n == 0 ? getAvailableCpuCount() : n;
+}
+
+unsigned int ThreadBudget::capacity() const
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    return total;
+}
+
+unsigned int ThreadBudget::inUse() const
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    return used;
+}
+
+unsigned int ThreadBudget::leaseCount() const
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    return leases;
+}
+
+unsigned int ThreadBudget::acquire(unsigned int want)
+{
+    std::lock_guard<std::mutex> locker(mutex);
+
+    //平均份额按包括本次在内的租约数向上取整计算
+    unsigned int share = (total + leases) / (leases + 1);
+    unsigned int remaining = used < total ? total - used : 0;
+    unsigned int granted = std::max(1u, std::min({want, remaining, share}));
+
+    used += granted;
+    ++leases;
+    return granted;
+}
+
+void ThreadBudget::release(unsigned int granted)
+{
+    std::lock_guard<std::mutex> locker(mutex);
+    used -= std::min(used, granted);
+    if(leases > 0) {
+        --leases;
+    }
+}
+
+ThreadLease::ThreadLease(unsigned int want)
+    : granted(ThreadBudget::instance().acquire(want))
+{
+}
+
+ThreadLease::~ThreadLease()
+{
+    ThreadBudget::instance().release(granted);
+}
+
+unsigned int ThreadLease::count() const
+{
+    return granted;
+}
+
+}
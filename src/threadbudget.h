@@ -0,0 +1,55 @@
+#pragma once
+
+#include <mutex>
+
+namespace DeepinOCRPlugin {
+
+//进程内全部插件实例共享的推理线程预算
+//每个推理阶段开始时租用线程，结束时归还，租用的总数不超过预算，避免多个实例同时推理时线程数超过CPU数
+class ThreadBudget
+{
+public:
+    static ThreadBudget &instance();
+
+    //预算的总线程数，为0时使用当前可用的CPU数
+    void setCapacity(unsigned int n);
+    unsigned int capacity() const;
+
+    //当前已租出的线程数和租约数
+    unsigned int inUse() const;
+    unsigned int leaseCount() const;
+
+    //租用最多want个线程，返回实际分到的线程数，至少为1
+    //分配时不超过剩余的线程数，并且有其他租约时不超过平均份额，使并发的推理逐步趋于平分
+    unsigned int acquire(unsigned int want);
+
+    //归还acquire分到的线程
+    void release(unsigned int granted);
+
+private:
+    ThreadBudget();
+
+    mutable std::mutex mutex;
+    unsigned int total = 1;
+    unsigned int used = 0;
+    unsigned int leases = 0;
+};
+
+//一次推理阶段的线程租约，析构时自动归还
+class ThreadLease
+{
+public:
+    explicit ThreadLease(unsigned int want);
+    ~ThreadLease();
+
+    ThreadLease(const ThreadLease &) = delete;
+    ThreadLease &operator=(const ThreadLease &) = delete;
+
+    //分到的线程数
+    unsigned int count() const;
+
+private:
+    unsigned int granted;
+};
+
+}
@@ -1,11 +1,18 @@
 #include "toolkits.h"
 
 #include <string.h>
+#include <stdlib.h>
 #include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <thread>
 
 #include <dirent.h>
 #include <sys/stat.h>
 #include <dlfcn.h>
+#include <sched.h>
+#include <unistd.h>
 
 std::vector<std::string> getSubDirNames(const std::string &rootDir)
 {
@@ -20,12 +27,17 @@ std::vector<std::string> getSubDirNames(const std::string &rootDir)
     struct stat s_buf;
     while ((ptr = readdir(dir)) != nullptr) {
         if (strcmp(ptr->d_name, ".") != 0 && strcmp(ptr->d_name, "..") != 0) {
-            stat((rootDir + "/" + ptr->d_name).c_str(), &s_buf);
-            if (S_ISDIR(s_buf.st_mode)) {
+            //readdir已给出类型时不再stat，只有符号链接和未知类型需要确认
+            bool isDir = ptr->d_type == DT_DIR;
+            if (ptr->d_type == DT_LNK || ptr->d_type == DT_UNKNOWN) {
+                isDir = stat((rootDir + "/" + ptr->d_name).c_str(), &s_buf) == 0 && S_ISDIR(s_buf.st_mode);
+            }
+            if (isDir) {
                 result.push_back(ptr->d_name);
             }
         }
     }
+    closedir(dir);
 
     return result;
 }
@@ -56,3 +68,127 @@ std::string getCurrentModuleDir()
 
     return result;
 }
+
+std::string getUserCacheDir()
+{
+    const char *cacheHome = getenv("XDG_CACHE_HOME");
+    if(cacheHome != nullptr && cacheHome[0] == '/') {
+        return std::string(cacheHome) + "/deepin-ocr-plugin-manager";
+    }
+
+    const char *home = getenv("HOME");
+    if(home != nullptr && home[0] == '/') {
+        return std::string(home) + "/.cache/deepin-ocr-plugin-manager";
+    }
+
+    return "";
+}
+
+//读取cgroup v2的cpu.max，格式为"配额 周期"，配额为max时表示不限制
+static double readCgroupV2Quota(const std::string &dir)
+{
+    std::ifstream fs(dir + "/cpu.max");
+    std::string quota;
+    double period = 0;
+    if(!(fs >> quota >> period) || quota == "max" || period <= 0) {
+        return 0;
+    }
+    return atof(quota.c_str()) / period;
+}
+
+//读取cgroup v1的cpu.cfs_quota_us和cpu.cfs_period_us，配额为-1时表示不限制
+static double readCgroupV1Quota(const std::string &dir)
+{
+    std::ifstream quotaFs(dir + "/cpu.cfs_quota_us");
+    std::ifstream periodFs(dir + "/cpu.cfs_period_us");
+    double quota = 0;
+    double period = 0;
+    if(!(quotaFs >> quota) || !(periodFs >> period) || quota <= 0 || period <= 0) {
+        return 0;
+    }
+    return quota / period;
+}
+
+double getCgroupCpuQuota()
+{
+    //每行的格式为"层级编号:控制器列表:路径"，cgroup v2只有一行，层级编号为0且控制器列表为空
+    std::ifstream fs("/proc/self/cgroup");
+    std::string line;
+    double result = 0;
+    while(std::getline(fs, line)) {
+        size_t first = line.find(':');
+        size_t second = line.find(':', first + 1);
+        if(first == std::string::npos || second == std::string::npos) {
+            continue;
+        }
+
+        std::string controllers = line.substr(first + 1, second - first - 1);
+        std::string path = line.substr(second + 1);
+        std::string root;
+        bool isV2 = controllers.empty();
+        if(isV2) {
+            root = "/sys/fs/cgroup";
+        } else {
+            std::stringstream ss(controllers);
+            std::string controller;
+            bool hasCpu = false;
+            while(std::getline(ss, controller, ',')) {
+                hasCpu = hasCpu || controller == "cpu";
+            }
+            if(!hasCpu) {
+                continue;
+            }
+            root = "/sys/fs/cgroup/" + controllers;
+            if(access(root.c_str(), F_OK) != 0) {
+                root = "/sys/fs/cgroup/cpu";
+            }
+        }
+
+        //配额可能设置在上层的cgroup（例如systemd的slice）中，逐级向上取最小值
+        //容器中路径可能不在挂载点下，此时只能读到挂载点本身的配额
+        while(true) {
+            std::string dir = root + path;
+            if(access(dir.c_str(), F_OK) == 0) {
+                double quota = isV2 ? readCgroupV2Quota(dir) : readCgroupV1Quota(dir);
+                if(quota > 0 && (result <= 0 || quota < result)) {
+                    result = quota;
+                }
+            }
+            if(path.empty() || path == "/") {
+                break;
+            }
+            size_t pos = path.find_last_of('/');
+            path = pos == 0 || pos == std::string::npos ? "/" : path.substr(0, pos);
+        }
+    }
+
+    return result;
+}
+
+unsigned int getAvailableCpuCount()
+{
+    unsigned int result = std::thread::hardware_concurrency();
+
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if(sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        result = static_cast<unsigned int>(CPU_COUNT(&mask));
+    }
+
+    //配额不足一个CPU时仍按一个计算，小数部分向上取整
+    double quota = getCgroupCpuQuota();
+    if(quota > 0) {
+        result = std::min(result, static_cast<unsigned int>(std::ceil(quota)));
+    }
+
+    return std::max(result, 1u);
+}
+
+double getLoadAverage()
+{
+    double load = 0;
+    if(getloadavg(&load, 1) != 1) {
+        return -1;
+    }
+    return load;
+}
@@ -15,3 +15,15 @@ std::vector<std::string> getSubDirNames(const std::string &rootDir);
 
 //获取动态库当前目录
 std::string getCurrentModuleDir();
+
+//获取当前用户的缓存目录，优先使用XDG_CACHE_HOME，获取失败时返回空字符串
+std::string getUserCacheDir();
+
+//获取cgroup（v1或v2）限制的CPU配额，以可使用的CPU个数表示，可以为小数；没有限制或读取失败时返回0
+double getCgroupCpuQuota();
+
+//获取当前进程实际可用的CPU数，综合CPU亲和性掩码和cgroup的CPU配额，至少为1
+unsigned int getAvailableCpuCount();
+
+//获取系统最近1分钟的平均负载，读取失败时返回-1
+double getLoadAverage();